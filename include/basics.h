@@ -54,12 +54,21 @@ enum InterpModes {
 #define rotReal rw
 #define rotImag rz
 
+/* Transforms track changes, writes through getComponentMut/TRANSFORMS.mut or followed by clMarkChanged are seen by clNextChanged */
 struct Transform {
 	entity_t entity;
 	float x, y, z;
 	float rx, ry, rz, rw;
 };
 
+/* Transforms at the end of the last two simulation ticks, kept for every Transform to draw between them */
+struct TransformInterp {
+	entity_t entity;
+	struct Transform prev;
+	struct Transform last;
+	bool restart; /* The Transform was removed and added again, don't move from the old one */
+};
+
 struct IchigoLocals {
 	entity_t entity;
 	int i[4];
@@ -115,6 +124,22 @@ float randomFloat(float min, float max);
 
 void tfSetRotation3D(struct Transform *tf, float rx, float ry, float rz);
 
+/*
+ * Get a transform as it should be drawn: between its state at the end of the last two ticks, by tickAlpha.
+ * Drawing lags the simulation by one tick, but moves smoothly at any frame rate.
+ */
+void tfInterpolated(struct Transform *out, const struct Transform *tf);
+
+/*
+ * Make an entity jump to its current transform instead of moving there during the next tick, for teleports
+ */
+void tfSnap(entity_t en);
+
+/*
+ * Store the transforms of the tick that just ended, called by the event loop
+ */
+void tfTickEnd(void);
+
 
 extern struct IchigoLocals *ichigoLocalsCur;
 void ichigoBindLocals(struct IchigoState *is);
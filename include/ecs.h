@@ -37,12 +37,17 @@ typedef uint32_t idx_t;
 #define PHYS_CHARACTER 111
 /* Ichigo heap objects */
 #define ICHIGO_HEAP_OBJ 112
+/* basics.h */
+#define TRANSFORM_INTERP 113
 #define MAX_COMPONENTLIST 128
 
 /* Notfier definitions */
 #define NOTIFY_CREATE	0
 #define NOTIFY_DELETE	1
 #define NOTIFY_PURGE	2
+#define NOTIFY_SNAPSHOT	3 /* Component was copied into a snapshot, give the copy its own heap data */
+#define NOTIFY_RESTORE	4 /* Component was copied back from a snapshot, give it its own heap data */
+#define NOTIFY_SNAPSHOT_FREE	5 /* Snapshot copy is about to be freed */
 
 
 /**
@@ -51,6 +56,15 @@ typedef uint32_t idx_t;
 #define componentListInit(cl, type) componentListInitSz(cl, sizeof(type))
 void componentListInitSz(int id, unsigned int elementSize);
 
+/**
+ * Create a component list with structure-of-arrays storage. Every dense page holds one array per field,
+ * so loops that only touch some fields do not pull whole components through the cache.
+ * getComponent, clNext, views and notifiers return a pointer to the entity_t of a component,
+ * use clField to reach its fields.
+ */
+#define CL_SOA_MAX_FIELDS 16
+void componentListInitSoA(int id, unsigned int nFields, const unsigned int *fieldSizes);
+
 /**
  * Delete a component list
  */
@@ -76,6 +90,19 @@ void *newComponent(int id, entity_t entity);
  */
 void removeComponent(int id, entity_t entity);
 
+/**
+ * Add a component to n unique entities at once, notifiers are called after all components are in place.
+ * Returns the dense index of the first appended component, the appended ones follow in order (see clAt).
+ * Entities that already have the component are reset in place and are not part of that range.
+ */
+idx_t newComponents(int id, unsigned int n, const entity_t *entities);
+
+/**
+ * Remove a component from n entities with a single compaction pass.
+ * The notifier may remove more components from the same list, they are compacted in the same pass.
+ */
+void removeComponents(int id, unsigned int n, const entity_t *entities);
+
 /**
  * Get the number of components inside a component list
  */
@@ -83,11 +110,119 @@ idx_t clCount(int id);
 
 void *clAt(int id, idx_t idx);
 
+/**
+ * Get a field of a component in a structure-of-arrays list, component is a pointer returned by getComponent or iteration
+ */
+void *clField(int id, const void *component, unsigned int field);
+
+/**
+ * Get the contiguous array of a field for dense page page (components page * 1024 and up) of a structure-of-arrays list.
+ * The array is 16 byte aligned, n is set to the number of entries, it may contain holes in ordered lists (entity 0).
+ * Returns NULL past the end of the list.
+ */
+void *clFieldPage(int id, unsigned int page, unsigned int field, idx_t *n);
+
 void *clBegin(int id);
 
 void *clNext(int id, void *it);
 
 
+/**
+ * Iterate all entities that have a component in every one of a set of lists.
+ * Iteration is driven by the smallest list, other lists are only looked up for matching entities.
+ * Components may not be added or removed from any of the lists while a view is in use.
+ */
+#define CL_VIEW_MAX 8
+struct ComponentView {
+	int nLists;
+	int ids[CL_VIEW_MAX];
+	int driver;
+	idx_t idx;
+	uint64_t mask[2];
+
+	/* Components of the current entity, in the same order as ids */
+	void *c[CL_VIEW_MAX];
+};
+
+void clViewInit(struct ComponentView *view, int nLists, const int *ids);
+
+/**
+ * Advance to the next matching entity, returns false at the end
+ */
+bool clViewNext(struct ComponentView *view);
+
+
+typedef void ParallelForFunc(unsigned int n, void (*fn)(void *arg, unsigned int i), void *arg);
+
+/**
+ * Set the function used to spread clParallelForEach over threads, NULL runs everything on the calling thread
+ */
+void ecsSetParallelFor(ParallelForFunc *func);
+
+/**
+ * Call fn for every component in a list, one dense page (1024 components) per job.
+ * The callback may only modify the component it is given and read other components.
+ * Creating or removing components or entities and notifiers are not thread safe,
+ * any structural change has to be deferred until after the call returns.
+ */
+void clParallelForEach(int id, void (*fn)(void *arg, void *component), void *arg);
+
+
+/*
+ * Command buffers record structural changes so they can be applied later at a sync point,
+ * which keeps component pointers and iterators valid while a list is being walked.
+ */
+
+#define ECS_MAX_THREADS 16
+
+struct EcsCmdBlock;
+struct EcsCmdBuffer {
+	struct Vector cmds;
+	struct EcsCmdBlock *blocks; /* Staging memory for init data */
+};
+
+void ecsCmdCreate(struct EcsCmdBuffer *buf);
+void ecsCmdDestroy(struct EcsCmdBuffer *buf);
+
+/**
+ * Record newComponent(id, entity). If init is set, it is called with the new component after the create notifier,
+ * the returned pointer is dataSize bytes of zeroed memory that is passed to init as data.
+ * The component is not created if the entity is deleted before the flush.
+ */
+void *ecsCmdNewComponent(struct EcsCmdBuffer *buf, int id, entity_t entity,
+	void (*init)(void *component, void *data), size_t dataSize);
+
+/**
+ * Record removeComponent(id, entity)
+ */
+void ecsCmdRemoveComponent(struct EcsCmdBuffer *buf, int id, entity_t entity);
+
+/**
+ * Record deleteEntity(entity)
+ */
+void ecsCmdDeleteEntity(struct EcsCmdBuffer *buf, entity_t entity);
+
+/**
+ * Apply all recorded commands in order and clear the buffer. Must be called from the main thread.
+ */
+void ecsCmdFlush(struct EcsCmdBuffer *buf);
+
+/**
+ * Command buffer of the calling thread, for use inside clParallelForEach callbacks
+ */
+struct EcsCmdBuffer *ecsCmdThreadBuffer(void);
+
+/**
+ * Flush the buffers of all threads, in thread order. Must be called from the main thread with no jobs running.
+ */
+void ecsCmdFlushAll(void);
+
+/**
+ * Set the function that returns the index (0 to ECS_MAX_THREADS - 1) of the calling thread, NULL means single threaded
+ */
+void ecsSetThreadIndex(int (*func)(void));
+
+
 /**
  * Set a notifier for adding and removing components
  * Bool added is set to true if a component is added, false if removed
@@ -104,6 +239,89 @@ void componentListAllowPurge(int id, bool allow);
 void componentListKeepOrdering(int id, bool keep);
 void componentListOrderedClean(int id);
 
+/**
+ * Sort the dense storage of a list by cmp, which gets two components. Equal components keep their order
+ * and holes left by ordered lists are removed. Returns false without touching anything if the list was already sorted.
+ * Moves components, so don't call it while the list is iterated or while holding pointers into it.
+ */
+bool componentListSort(int id, int (*cmp)(const void *a, const void *b));
+
+/**
+ * Move the components of id whose entities are also in leader to the front, in the dense order of leader.
+ * Returns n, the first n components of both lists then belong to the same entities (if leader has no holes),
+ * so joins over them are linear. Adding or removing components breaks the grouping until the next call.
+ */
+idx_t componentListGroup(int id, int leader);
+
+
+/*
+ * Change tracking: lists that track changes keep a change tick for every component.
+ * Creating a component or accessing it through the *Mut functions marks it as changed,
+ * writes through plain pointers are not seen.
+ *
+ * A system that only wants changed components keeps the tick it last saw:
+ * 	uint32_t since = lastTick;
+ * 	lastTick = ecsAdvanceChangeTick();
+ * 	for (idx_t i = 0; (c = clNextChanged(id, &i, since));) { ... }
+ */
+
+/**
+ * Enable or disable change tracking for a list, components that already exist are marked as changed
+ * Default: false
+ */
+void componentListTrackChanges(int id, bool track);
+
+/**
+ * Start a new change tick and return the previous one, changes made after this call are newer than the returned tick
+ */
+uint32_t ecsAdvanceChangeTick(void);
+
+/**
+ * Mark a component as changed
+ */
+void clMarkChanged(int id, entity_t entity);
+
+/**
+ * Like getComponent and getComponentOpt, but mark the component as changed
+ */
+void *getComponentMut(int id, entity_t entity);
+void *getComponentOptMut(int id, entity_t entity);
+
+/**
+ * Returns true if the component was changed after tick since, always true if the list doesn't track changes
+ */
+bool clChangedSince(int id, entity_t entity, uint32_t since);
+
+/**
+ * Return the next component at or after dense index *idx that changed after tick since and advance *idx past it.
+ * Start with *idx = 0, returns NULL at the end. Returns every component if the list doesn't track changes.
+ */
+void *clNextChanged(int id, idx_t *idx, uint32_t since);
+
+/*
+ * Snapshots copy the state of all component lists and entities so it can be restored later in the same scene.
+ * Restoring sends NOTIFY_DELETE to the current components and NOTIFY_RESTORE to the restored ones,
+ * lists whose components hold pointers have to handle NOTIFY_SNAPSHOT, NOTIFY_RESTORE and NOTIFY_SNAPSHOT_FREE.
+ */
+struct EcsSnapshot;
+
+/**
+ * Include a list in snapshots. Lists that are left out keep their current components on restore,
+ * except those of entities that did not exist in the snapshot, which are removed with NOTIFY_DELETE.
+ * Default: true
+ */
+void componentListAllowSnapshot(int id, bool allow);
+
+struct EcsSnapshot *ecsSnapshot(void);
+
+/**
+ * Restore a snapshot, the snapshot stays valid and can be restored again. Don't call it while iterating.
+ */
+void ecsRestore(const struct EcsSnapshot *snap);
+
+void ecsSnapshotFree(struct EcsSnapshot *snap);
+
+
 /**
  * Purge all component lists that allow it
  */
@@ -118,11 +336,26 @@ entity_t newEntity(void);
 
 void deleteEntity(entity_t entity);
 
+/**
+ * Get n new entity IDs
+ */
+void newEntities(unsigned int n, entity_t *out);
+
+/**
+ * Delete n entities, components are removed with one removeComponents call per list
+ */
+void deleteEntities(unsigned int n, const entity_t *entities);
+
 
 #ifdef __cplusplus
 
 } // extern "C"
 
+#include <tuple>
+#include <utility>
+#include <type_traits>
+#include <new>
+
 template <typename T, int id>
 class ClIterator {
 public:
@@ -164,6 +397,9 @@ private:
 template <typename T, int id>
 class ClWrapper {
 public:
+	typedef T Type;
+	static constexpr int listId = id;
+
 	void init() const {
 		componentListInitSz(id, sizeof(T));
 	}
@@ -180,6 +416,18 @@ public:
 	T *opt(entity_t en) const {
 		return static_cast<T *>(getComponentOpt(id, en));
 	}
+	T &mut(entity_t en) const {
+		return *static_cast<T *>(getComponentMut(id, en));
+	}
+	T *optMut(entity_t en) const {
+		return static_cast<T *>(getComponentOptMut(id, en));
+	}
+	void markChanged(entity_t en) const {
+		clMarkChanged(id, en);
+	}
+	bool changedSince(entity_t en, uint32_t since) const {
+		return clChangedSince(id, en, since);
+	}
 
 	T &add(entity_t en) const {
 		return *static_cast<T *>(newComponent(id, en));
@@ -188,6 +436,22 @@ public:
 		removeComponent(id, en);
 	}
 
+	idx_t addAll(unsigned int n, const entity_t *ens) const {
+		return newComponents(id, n, ens);
+	}
+	void removeAll(unsigned int n, const entity_t *ens) const {
+		removeComponents(id, n, ens);
+	}
+
+	/* See clParallelForEach for what fn is allowed to do */
+	template <typename F>
+	void parallelForEach(F &&fn) const {
+		typedef typename std::remove_reference<F>::type Fn;
+		clParallelForEach(id, [](void *arg, void *c) {
+			(*static_cast<Fn *>(arg))(*static_cast<T *>(c));
+		}, const_cast<void *>(static_cast<const void *>(&fn)));
+	}
+
 	ClIterator<T, id> begin() const {
 		return ClIterator<T, id>(clBegin(id));
 	}
@@ -196,6 +460,82 @@ public:
 	}
 };
 
+/*
+ * Record adding a component, fn(T &) runs on it after the create notifier.
+ * fn is stored in the command buffer and never destroyed, so it may only capture by value things without a destructor.
+ */
+template <typename T, int id, typename F>
+void ecsCmdAdd(EcsCmdBuffer *buf, const ClWrapper<T, id> &, entity_t en, F fn) {
+	static_assert(std::is_trivially_destructible<F>::value, "ecsCmdAdd: fn must be trivially destructible");
+	void *data = ecsCmdNewComponent(buf, id, en, [](void *c, void *d) {
+		(*static_cast<F *>(d))(*static_cast<T *>(c));
+	}, sizeof(F));
+	new (data) F(fn);
+}
+
+template <typename... Cls>
+class ClViewIterator {
+public:
+	ClViewIterator(ComponentView *v) : view(v) {
+
+	}
+
+	bool operator==(const ClViewIterator &other) const {
+		return view == other.view;
+	}
+	bool operator!=(const ClViewIterator &other) const {
+		return view != other.view;
+	}
+
+	ClViewIterator &operator++() {
+		if (!clViewNext(view))
+			view = nullptr;
+		return *this;
+	}
+
+	std::tuple<typename Cls::Type *...> operator*() const {
+		return get(std::index_sequence_for<Cls...>{});
+	}
+
+private:
+	template <size_t... i>
+	std::tuple<typename Cls::Type *...> get(std::index_sequence<i...>) const {
+		return std::tuple<typename Cls::Type *...>(static_cast<typename Cls::Type *>(view->c[i])...);
+	}
+
+	ComponentView *view;
+};
+
+/**
+ * Join over ClWrappers, yields a tuple of component pointers:
+ * for (auto [b, tf] : clView(PHYS_BODIES, TRANSFORMS)) { ... }
+ */
+template <typename... Cls>
+class ClView {
+public:
+	ClView() {
+		const int ids[] = { Cls::listId... };
+		clViewInit(&view, sizeof...(Cls), ids);
+	}
+
+	ClViewIterator<Cls...> begin() {
+		ClViewIterator<Cls...> it(&view);
+		++it;
+		return it;
+	}
+	ClViewIterator<Cls...> end() {
+		return ClViewIterator<Cls...>(nullptr);
+	}
+
+private:
+	ComponentView view;
+};
+
+template <typename... Cls>
+ClView<Cls...> clView(const Cls &...) {
+	return ClView<Cls...>();
+}
+
 #endif
 
 #endif
@@ -3,6 +3,7 @@
 
 #include <SDL2/SDL_keycode.h>
 #include <stdbool.h>
+#include <mem.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -15,6 +16,8 @@ extern "C" {
 #define EVENT_MOUSEWHEEL 16
 #define EVENT_GAMEPAD_BTN 32
 
+#define TICK_RATE 60 /* Simulation ticks per second, the same as PHYS_TICKRATE */
+
 #define UPDATE_PHYS		0
 #define UPDATE_NORM		1
 #define UPDATE_LATE		2
@@ -36,6 +39,16 @@ struct Event {
 };
 
 
+/* Frame pacer statistics, updated once a second */
+struct FramePacing {
+	float jitterUs; /* Mean time the pacer returned after the deadline */
+	float worstLateUs;
+	float slackUs; /* How long before the deadline the pacer wakes up to spin */
+	float spinUs; /* Mean spin time per frame */
+	float cpuUsage; /* Fraction of wall time the main thread ran, -1 if unknown */
+	unsigned int missed; /* Frames that were late before the pacer started waiting */
+};
+
 struct UpdateTiming {
 	float phys;
 	float physEngine;
@@ -44,13 +57,28 @@ struct UpdateTiming {
 	float ui;
 	float draw;
 	float total;
+	int ticks; /* Simulation ticks run during the frame, the other times are summed over them */
+	float parallelism; /* Summed update callback time divided by the time the update phases took, 1 is serial */
 };
 
-extern float deltaTime;
+/* Frame time statistics of the current scene, frames during loading are left out */
+struct FrameStats {
+	const char *scene;
+	unsigned int frames;
+	unsigned int hitches; /* Frames longer than one and a half display intervals */
+	float p50, p95, p99, max; /* Frame times in ms, the percentiles are accurate to 0.1ms */
+	struct UpdateTiming peak; /* Largest value of each phase time */
+};
+
+extern float deltaTime; /* Length of a simulation tick */
+extern float tickAlpha; /* Part of a tick that passed since the last one ended, for drawing between ticks */
 extern float fps;
 extern float frameTimeMs;
 extern struct UpdateTiming updateTiming;
+extern struct FramePacing framePacing;
+extern struct MemTagStats updateMemory[MEM_TAG_COUNT]; /* Per tag memory use of the last frame */
 extern bool eventBlockUpdates;
+extern bool frameStatsCsv; /* Append the statistics of every scene to framestats.csv in the user directory when it ends */
 extern float gameSpeed;
 
 extern const char *sceneName;
@@ -63,6 +91,17 @@ extern const char *sceneName;
  */
 void addUpdate(int type, void (*callback)(void *arg), void *arg);
 
+/**
+ * Add an update function that declares the component lists it uses. Update functions of the same type
+ * that do not write anything the other reads or writes run at the same time on the job threads,
+ * otherwise they run in the order they were added. Functions added with addUpdate use everything.
+ * The callback must only make structural ECS changes through ecsCmdThreadBuffer() and must not touch
+ * other shared state, such as scripts or the draw VMs.
+ * @param reads Component list IDs the function reads, ending with -1, can be NULL
+ * @param writes Component list IDs the function writes, ending with -1, can be NULL
+ */
+void addUpdateAccess(int type, void (*callback)(void *arg), void *arg, const int *reads, const int *writes);
+
 /**
  * Remove an update function
  */
@@ -92,6 +131,11 @@ void loadUpdatePoll(void);
 void loadingDelay(int frames);
 
 
+/**
+ * Get the frame time statistics since the current scene started
+ */
+void frameStatsGet(struct FrameStats *stats);
+
 /**
  * Get the time in seconds
  */
@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include <vec.h>
+#include <mem.h>
 
 #define DRAW_MAX_BONE 32
 
@@ -55,19 +56,22 @@ struct PoseFileHeader {
 	unsigned int nAnim;
 };
 struct LoadedPoseFile {
-	struct PoseFileHeader hdr;
+	strid_t *animIds; /* Interned animation names, in file order */
+	struct PoseFileAnim **anims;
+	struct PoseFileHeader hdr; /* File data follows */
 };
 
 struct Anim3DState {
 	entity_t entity;
 	struct LoadedPoseFile *poseFile;
-	const char *animName;
+	strid_t animName; /* Interned */
 	float animSpeed;
 	float animTime;
 	int flags;
 
 	void *globals;
 	void (*event)(struct Anim3DState *self);
+	bool eventPending; /* Set by the parallel update, fired afterwards on the main thread */
 
 	int nBones;
 	Mat *mats;
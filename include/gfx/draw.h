@@ -93,7 +93,6 @@ struct ModelFileEntry {
 };
 
 struct Model {
-	struct HTEntry en;
 	char name[MODEL_NAME_LEN];
 	int flags;
 	uint32_t nTriangles;
@@ -193,6 +192,7 @@ void drawSetSkybox(const char *texture);
 
 /* Shader stuff */
 struct Shader *drawShaderNew(const char *vert, const char *frag);
+struct Shader *drawShaderRef(struct Shader *s); /* Take another reference, drawShaderDelete drops one */
 void drawShaderDelete(struct Shader *s);
 void drawShaderUse(struct Shader *s);
 void drawShaderUseStd(enum StdShader s);
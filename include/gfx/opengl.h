@@ -6,6 +6,7 @@
 
 struct Shader {
 	unsigned int glShader;
+	int refs;
 };
 
 #endif
@@ -23,9 +23,9 @@ void ichFreeFile(void *userData);
 #include <assets.h>
 #include <ecs.h>
 #define ENTITY entity_t
-#define ichAlloc(sz) globalAlloc(sz)
+#define ichAlloc(sz) globalAllocTag(sz, MEM_TAG_ICHIGO)
 #define ichFree(ptr) globalDealloc(ptr)
-#define ichRealloc(ptr, sz) globalRealloc(ptr, sz)
+#define ichRealloc(ptr, sz) globalReallocTag(ptr, sz, MEM_TAG_ICHIGO)
 #define logError(...) logNorm(__VA_ARGS__);
 
 struct IchigoVector {
@@ -120,6 +120,7 @@ struct IchigoInstrArg {
 struct IchigoState {
 	struct IchigoVector files;
 	struct IchigoVector fns;
+	struct HashMap fnMap; /* Interned function name -> struct IchigoFn * */
 	struct IchigoVector globals;
 	struct IchigoVector vms;
 
@@ -146,6 +147,7 @@ struct IchigoHeapObject {
 	ENTITY entity;
 	int refCount;
 	uint32_t len;
+	uint32_t size; /* Bytes allocated for data */
 	void *data;
 };
 
@@ -162,6 +164,10 @@ void ichigoSetVarTable(struct IchigoState *state, struct IchigoVar *vars, int nV
 
 int ichigoVmNew(struct IchigoState *state, struct IchigoVm *newVm, ENTITY en);
 void ichigoVmDelete(struct IchigoVm *vm);
+
+/* For snapshots: give a bytewise copy of a VM its own coroutine stacks, or free the stacks of such a copy */
+void ichigoVmCloneStacks(struct IchigoVm *vm);
+void ichigoVmFreeStacks(struct IchigoVm *vm);
 int ichigoVmExec(struct IchigoVm *vm, const char *fn, const char *params, ...); /* returns coroutine ID (or negative if error) */
 void ichigoVmKill(struct IchigoVm *vm, int coroutine);
 void ichigoVmKillAll(struct IchigoVm *vm);
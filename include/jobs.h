@@ -0,0 +1,34 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <ecs.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Each thread gets its own ECS command buffer */
+#define JOBS_MAX_THREADS ECS_MAX_THREADS
+
+/**
+ * Number of threads that run jobs, including the main thread
+ */
+int jobsThreadCount(void);
+
+/**
+ * Index of the calling thread, 0 is the main thread and workers are numbered 1 to jobsThreadCount() - 1
+ */
+int jobsThreadIndex(void);
+
+/**
+ * Call fn(arg, i) for every i in [0, n) spread over the worker pool, returns when all calls are done.
+ * The main thread takes part in the work. Nested calls from inside a job run on the calling thread.
+ */
+void jobsParallelFor(unsigned int n, void (*fn)(void *arg, unsigned int i), void *arg);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+#endif
@@ -9,13 +9,54 @@
 extern "C" {
 #endif
 
-struct CacheEntry;
+/*
+ * Subsystem that owns an allocation. The allocation functions below are macros that pass MEM_TAG,
+ * define it before including any header to tag everything a source file allocates.
+ */
+enum MemTag {
+	MEM_TAG_GENERAL,
+	MEM_TAG_ECS,
+	MEM_TAG_ASSET,
+	MEM_TAG_ICHIGO,
+	MEM_TAG_DRAW,
+	MEM_TAG_PHYSICS,
+	MEM_TAG_AUDIO,
+	MEM_TAG_COUNT
+};
+#ifndef MEM_TAG
+#define MEM_TAG MEM_TAG_GENERAL
+#endif
+
+struct MemTagStats {
+	size_t liveBytes;
+	size_t peakBytes;
+	unsigned int frameAllocs; /* Global heap, cache and bigstack allocations during the last frame */
+};
+
+struct CacheStats {
+	size_t objSize;
+	size_t live; /* Objects taken from pages, including those in per-thread magazines */
+	unsigned int pages;
+	unsigned int emptyPages;
+	size_t pagesFreed; /* Empty pages given back since creation */
+	unsigned long gets;
+	unsigned long releases;
+};
+
 struct CachePage;
 struct Cache {
 	const char *name;
+	int tag;
+	int id; /* Magazine slot, -1 if the cache has none */
+	unsigned int gen;
 	size_t objSize;
-	struct CacheEntry *list;
-	struct CachePage *pList;
+	unsigned int maxEmptyPages;
+	volatile long lock;
+	volatile long gets;
+	volatile long releases;
+	struct CachePage *partial; /* Pages with free objects */
+	struct CachePage *full;
+	struct CacheStats stats;
 };
 
 /*
@@ -24,9 +65,11 @@ struct Cache {
 void memInit(void);
 
 /*
- * Allocator for temporary memory, like a second stack. Data allocated must be deallocated in reverse order
+ * Allocator for temporary memory, like a second stack. Data allocated must be deallocated in reverse order.
+ * Every thread has its own stack, worker threads get a smaller one on their first allocation.
  */
-void *stackAlloc(size_t sz);
+#define stackAlloc(sz) stackAllocTag(sz, MEM_TAG)
+void *stackAllocTag(size_t sz, int tag);
 
 /*
  * Deallocate memory allocated by stackAlloc
@@ -34,9 +77,47 @@ void *stackAlloc(size_t sz);
 void stackDealloc(size_t sz);
 
 /*
- * Allocate memory on the global heap.
+ * Free the calling thread's stack and return its cache magazines, worker threads call this before they exit
+ */
+void memThreadFini(void);
+
+/*
+ * Allocate 16 byte aligned temporary memory that lives until the end of the current frame.
+ * Main thread only, the arena is reset at the end of every main update.
+ */
+void *frameAlloc(size_t sz);
+
+/*
+ * Get the current top of the frame arena, pass it to frameRewind to free everything allocated after it
+ */
+size_t frameMark(void);
+
+/*
+ * Free all frame arena memory allocated after mark was taken
+ */
+void frameRewind(size_t mark);
+
+/*
+ * Free all frame arena memory, called by the event loop at the end of a frame
+ */
+void frameReset(void);
+
+/*
+ * Get the highest number of bytes the frame arena has held at once
+ */
+size_t frameHighWater(void);
+
+/*
+ * Allocate zeroed memory on the global heap.
+ */
+#define globalAlloc(sz) globalAllocTag(sz, MEM_TAG)
+void *globalAllocTag(size_t sz, int tag);
+
+/*
+ * Allocate memory on the global heap without clearing it, for buffers that are overwritten right away.
  */
-void *globalAlloc(size_t sz);
+#define globalAllocUninit(sz) globalAllocUninitTag(sz, MEM_TAG)
+void *globalAllocUninitTag(size_t sz, int tag);
 
 /*
  * Deallocate memory on the global heap.
@@ -44,30 +125,84 @@ void *globalAlloc(size_t sz);
 void globalDealloc(void *mem);
 
 /*
- * Reallocate memory on the global heap.
+ * Reallocate memory on the global heap, memory past the old size is not cleared.
+ * The block keeps its tag, tag is only used when mem is NULL.
  */
-void *globalRealloc(void *mem, size_t newSz);
+#define globalRealloc(mem, newSz) globalReallocTag(mem, newSz, MEM_TAG)
+void *globalReallocTag(void *mem, size_t newSz, int tag);
+
+/*
+ * Global heap statistics, one entry per small size class followed by medium (malloc) and large (mapped) blocks
+ */
+#define HEAP_N_CLASSES 14
+struct HeapClassStats {
+	size_t objSize; /* Largest block size in this class, 0 for medium and large */
+	size_t live; /* Blocks currently allocated */
+	size_t liveBytes; /* Requested bytes currently allocated */
+	size_t free; /* Blocks on the free list */
+	size_t slabs; /* Slabs carved for this class */
+	uint64_t allocs; /* Allocations since startup */
+};
+void heapGetStats(struct HeapClassStats *out);
+
+/*
+ * Get the name of a MemTag
+ */
+const char *memTagName(int tag);
+
+/*
+ * Take the per tag statistics of the frame that just ended and start counting a new one.
+ * Called by the event loop, out may be NULL.
+ */
+void memTagFrameEnd(struct MemTagStats *out);
+
+/*
+ * Log the per tag statistics of the last frame
+ */
+void memDumpTags(void);
 
 /*
  * Create a cache for object storage
  */
-void cacheCreate(struct Cache * newCache, size_t size, const char * name);
+#define cacheCreate(newCache, size, name) cacheCreateTag(newCache, size, name, MEM_TAG)
+void cacheCreateTag(struct Cache * newCache, size_t size, const char * name, int tag);
 
 /*
- * Clear the cache of all objects, does not deallocate the cache struct
+ * Clear the cache of all objects, does not deallocate the cache struct.
+ * No other thread may use the cache during this call.
  */
 void cachePurge(struct Cache *cache);
 
 /*
- * Allocate an object in a cache
+ * Purge a cache and release its magazine slot, call this before the cache struct goes away
+ */
+void cacheDestroy(struct Cache *cache);
+
+/*
+ * Set how many empty pages a cache keeps around before it gives them back, the default is 1
+ */
+void cacheSetWatermark(struct Cache *cache, unsigned int maxEmptyPages);
+
+/*
+ * Allocate an object in a cache, safe from any thread
  */
 void *cacheGet(struct Cache *cache);
 
 /*
- * Deallocate an object in a cache
+ * Deallocate an object in a cache, safe from any thread
  */
 void cacheRelease(struct Cache * cache, void * obj);
 
+/*
+ * Get the statistics of a cache
+ */
+void cacheGetStats(struct Cache *cache, struct CacheStats *out);
+
+/*
+ * Log the statistics of every cache
+ */
+void cacheDumpStats(void);
+
 
 /*
  * Linked list
@@ -168,13 +303,34 @@ void vecDestroy(struct Vector *vec);
  */
 void *vecInsert(struct Vector *vec, int pos);
 
+/**
+ * Append n elements to a vector and return a pointer to the first one
+ * if elements == NULL the new elements are left uninitialized
+ */
+void *vecAppend(struct Vector *vec, const void *elements, unsigned int n);
+
 /**
  * Delete a vector entry
  */
 void vecDelete(struct Vector *vec, unsigned int index);
 
+/**
+ * Delete a vector entry by moving the last entry into its place, does not keep the order
+ */
+void vecSwapDelete(struct Vector *vec, unsigned int index);
+
 void vecClear(struct Vector *vec);
 
+/**
+ * Make room for at least n elements
+ */
+void vecReserve(struct Vector *vec, unsigned int n);
+
+/**
+ * Give back the memory that is not used by any element
+ */
+void vecShrink(struct Vector *vec);
+
 /**
  * Get vector element
  */
@@ -238,6 +394,102 @@ void HTDelete(struct HashTable *tbl, struct HTEntry *entry);
  */
 void HTDestroy(struct HashTable *tbl);
 
+
+/*
+Hash map
+*/
+
+/**
+ * FNV-1a hash of a string, never returns 0
+ */
+uint32_t hashString(const char *key);
+
+struct HashMapSlot {
+	const char *key;
+	void *value;
+};
+
+/*
+ * Open addressing with linear probing. Hashes are kept in their own array so a probe
+ * scans 16 of them per cache line and only touches a key when the full hash matches.
+ * Keys are not copied and must live as long as their entry.
+ */
+struct HashMap {
+	uint32_t *hashes; /* 0 = empty slot */
+	struct HashMapSlot *slots;
+	unsigned int capacity; /* Power of 2 */
+	unsigned int count;
+};
+
+/**
+ * Create a hash map with room for at least size entries before it grows
+ */
+void hashMapCreate(struct HashMap *map, unsigned int size);
+
+/**
+ * Destroy a hash map, does not deallocate keys or values
+ */
+void hashMapDestroy(struct HashMap *map);
+
+/**
+ * Get the value of a key, NULL if it is not in the map
+ */
+void *hashMapGetHashed(struct HashMap *map, const char *key, uint32_t hash);
+static inline void *hashMapGet(struct HashMap *map, const char *key) {
+	return hashMapGetHashed(map, key, hashString(key));
+}
+
+/**
+ * Add or replace a key, the map grows when it is 3/4 full
+ */
+void hashMapPutHashed(struct HashMap *map, const char *key, uint32_t hash, void *value);
+static inline void hashMapPut(struct HashMap *map, const char *key, void *value) {
+	hashMapPutHashed(map, key, hashString(key), value);
+}
+
+/**
+ * Remove a key and return its value, NULL if it was not in the map
+ */
+void *hashMapRemove(struct HashMap *map, const char *key);
+
+/**
+ * Iterate over all entries, start with *it = 0. Returns NULL when done.
+ * The map must not be changed while iterating.
+ */
+struct HashMapSlot *hashMapNext(struct HashMap *map, unsigned int *it);
+
+
+/*
+String interner
+*/
+
+/*
+ * Handle of an interned string. Equal strings get the same handle, so names can be compared
+ * and used as keys as integers. Handles stay valid for the whole run, 0 is never a string.
+ */
+typedef uint32_t strid_t;
+#define STR_NONE 0
+
+/**
+ * Get the handle of a string, interning a copy of it the first time. Safe from any thread.
+ */
+strid_t strIntern(const char *str);
+
+/**
+ * Same as strIntern, for strings that are not NUL terminated
+ */
+strid_t strInternLen(const char *str, size_t len);
+
+/**
+ * Get the handle of a string without interning it, STR_NONE if it was never interned
+ */
+strid_t strLookup(const char *str);
+
+/**
+ * Get the interned copy of a string, NULL for STR_NONE
+ */
+const char *strName(strid_t id);
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
@@ -19,6 +19,8 @@ extern "C" {
 #define PHYS_FLAG_CONTINUOUS_COLLISION 32
 #define PHYS_FLAG_SENSOR 64
 #define PHYS_FLAG_ANIM 128
+/* With SYNC_FROM_TF, only push the transform when it was marked changed (getComponentMut, TRANSFORMS.mut, clMarkChanged) */
+#define PHYS_FLAG_SYNC_CHANGED 256
 
 enum PhysLayer {
 	PHYS_LAYER_STATIC,
@@ -0,0 +1,85 @@
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Scoped profiling markers. Every thread records finished scopes into its own ring buffer,
+ * profDump writes the last PROF_RING_SIZE scopes of every thread as Chrome trace_event JSON
+ * (open it in chrome://tracing or ui.perfetto.dev).
+ * Markers are compiled out in release builds unless PROFILE is defined, otherwise they
+ * cost a branch on profRecording while recording is off.
+ */
+#if !defined(RELEASE) || defined(PROFILE)
+#define PROF_ENABLED
+#endif
+
+#define PROF_RING_SIZE 16384 /* Scopes kept per thread, must be a power of two */
+#define PROF_MAX_DEPTH 32
+#define PROF_MAX_THREADS 32
+#define PROF_DETAIL_LEN 32
+
+extern bool profRecording;
+
+/**
+ * Open a scope. name must stay valid until the next dump, usually a string literal.
+ * fn is an optional function address and detail an optional string that is copied, both are shown as arguments.
+ */
+void profBegin(const char *name, const void *fn, const char *detail);
+
+/**
+ * Close the innermost scope of the calling thread
+ */
+void profEnd(void);
+
+/**
+ * Start or stop recording. The change takes effect at the start of the next frame,
+ * stopping writes the recorded scopes to file in the user directory.
+ */
+void profStart(void);
+void profStop(const char *file);
+
+/**
+ * Write the recorded scopes to file in the user directory
+ */
+void profDump(const char *file);
+
+#ifdef PROF_ENABLED
+#define PROF_BEGIN(name) do { if (profRecording) profBegin(name, NULL, NULL); } while (0)
+#define PROF_BEGIN_FN(name, fn) do { if (profRecording) profBegin(name, (const void *)(fn), NULL); } while (0)
+#define PROF_BEGIN_DETAIL(name, detail) do { if (profRecording) profBegin(name, NULL, detail); } while (0)
+#define PROF_END() do { if (profRecording) profEnd(); } while (0)
+#else
+#define PROF_BEGIN(name) ((void)0)
+#define PROF_BEGIN_FN(name, fn) ((void)0)
+#define PROF_BEGIN_DETAIL(name, detail) ((void)0)
+#define PROF_END() ((void)0)
+#endif
+
+#ifdef __cplusplus
+} // extern "C"
+
+#ifdef PROF_ENABLED
+/* Profile until the end of the enclosing block */
+struct ProfScope {
+	ProfScope(const char *name) {
+		PROF_BEGIN(name);
+	}
+	~ProfScope() {
+		PROF_END();
+	}
+};
+#define PROF_SCOPE_CAT(a, b) a##b
+#define PROF_SCOPE_NAME(line) PROF_SCOPE_CAT(profScope, line)
+#define PROF_SCOPE(name) ProfScope PROF_SCOPE_NAME(__LINE__)(name)
+#else
+#define PROF_SCOPE(name) ((void)0)
+#endif
+#endif
+
+#endif
@@ -217,6 +217,18 @@ static inline Vec *matMulV3(Vec *out, const Mat *a, Vec *b) {
 	return matMulV4(out, a, b);
 }
 
+/* out[i] += v[i] * s over n floats, for field arrays of structure-of-arrays component lists. Both must be 16 byte aligned */
+static inline void vecArrayMulAddS(float *out, const float *v, float s, unsigned int n) {
+	__m128 sv = _mm_set_ps1(s);
+	unsigned int i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm_store_ps(out + i, _mm_add_ps(_mm_load_ps(out + i), _mm_mul_ps(_mm_load_ps(v + i), sv)));
+	}
+	for (; i < n; i++) {
+		out[i] += v[i] * s;
+	}
+}
+
 #else
 #error "I need SSE!"
 #endif
@@ -1,7 +1,9 @@
+#define MEM_TAG MEM_TAG_ASSET
 #include <assets.h>
 #include <ecs.h>
 #include <SDL2/SDL.h>
 #include <mem.h>
+#include <prof.h>
 
 #if defined(_WIN32) || defined(_WIN64)
 #define WIN32_LEAN_AND_MEAN
@@ -12,7 +14,7 @@
 /* Use stb_image for zlib decompression */
 /* Put the implementation here */
 #define STB_IMAGE_IMPLEMENTATION
-#define STBI_MALLOC(sz) (globalAlloc(sz))
+#define STBI_MALLOC(sz) (globalAllocUninit(sz))
 #define STBI_REALLOC(p, newsz) (globalRealloc(p, newsz))
 #define STBI_FREE(p) (globalDealloc(p))
 #define STBI_MAX_DIMENSIONS 16384
@@ -104,7 +106,8 @@ static bool tryLoadArchive(void** data, size_t* dataSize, int slot, const char *
 	}
 
 	/* Read it */
-	void* compressedData = stackAlloc(afe.compressedSize);
+	size_t mark = frameMark();
+	void* compressedData = frameAlloc(afe.compressedSize);
 	SDL_RWseek(ar, afe.offset, RW_SEEK_SET);
 	if (SDL_RWread(ar, compressedData, 1, afe.compressedSize) != afe.compressedSize) {
 		fail("Assets: failed to read compressed data\n");
@@ -119,7 +122,7 @@ static bool tryLoadArchive(void** data, size_t* dataSize, int slot, const char *
 	if ((unsigned int)uncompressedSize != afe.uncompressedSize) {
 		logNorm("Asset warning: Uncompressed size (%d) of %s is not what was expected (%d)\n", uncompressedSize, file, afe.uncompressedSize);
 	}
-	stackDealloc(afe.compressedSize);
+	frameRewind(mark);
 	
 	*dataSize = uncompressedSize;
 	*data = uncompressedData;
@@ -156,7 +159,7 @@ static bool tryLoadFile(void** data, size_t* dataSize, const char* file) {
 	}
 
 	/* Read it into memory */
-	void* dat = globalAlloc(fileSz);
+	void* dat = globalAllocUninit(fileSz);
 	SDL_RWseek(f, 0, RW_SEEK_SET);
 	if (SDL_RWread(f, dat, fileSz, 1) != 1) {
 		SDL_RWclose(f);
@@ -173,6 +176,7 @@ static bool tryLoadFile(void** data, size_t* dataSize, const char* file) {
 
 struct Asset *assetOpen(const char *file) {
 	logDebug("Load %s\n", file);
+	PROF_BEGIN_DETAIL("assetOpen", file);
 	bool found = false;
 	void* data;
 	size_t dataSize;
@@ -182,6 +186,7 @@ struct Asset *assetOpen(const char *file) {
 	}
 	if (!found) {
 		logNorm("Assets: Entry %s not found\n", file);
+		PROF_END();
 		return NULL;
 	}
 
@@ -190,6 +195,7 @@ struct Asset *assetOpen(const char *file) {
 	a->bufferSize = dataSize;
 	a->rwOps = SDL_RWFromConstMem(a->buffer, (int)a->bufferSize);
 
+	PROF_END();
 	return a;
 }
 
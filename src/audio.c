@@ -1,3 +1,4 @@
+#define MEM_TAG MEM_TAG_AUDIO
 #include <audio.h>
 #include <assets.h>
 #include <stdio.h>
@@ -52,6 +52,83 @@ static void newTransform(void *arg, void *component, int type) {
 	if (type == NOTIFY_CREATE) {
 		tf->rotReal = 1.0f;
 		tf->rw = 1.0f;
+		/* Left over if the entity had a Transform before, tfTickEnd removes it only at the end of the tick */
+		struct TransformInterp *ti = getComponentOpt(TRANSFORM_INTERP, tf->entity);
+		if (ti)
+			ti->restart = true;
+	}
+}
+
+void tfInterpolated(struct Transform *out, const struct Transform *tf) {
+	struct TransformInterp *ti = getComponentOpt(TRANSFORM_INTERP, tf->entity);
+	if (!ti) {
+		*out = *tf;
+		return;
+	}
+	const struct Transform *a = &ti->prev;
+	const struct Transform *b = &ti->last;
+	float t = tickAlpha;
+	out->entity = tf->entity;
+	out->x = lerp(a->x, b->x, t);
+	out->y = lerp(a->y, b->y, t);
+	out->z = lerp(a->z, b->z, t);
+
+	/* Normalized lerp along the shorter arc, close enough to slerp for one tick of rotation */
+	float s = (a->rx * b->rx + a->ry * b->ry + a->rz * b->rz + a->rw * b->rw) < 0 ? -t : t;
+	float rx = (1 - t) * a->rx + s * b->rx;
+	float ry = (1 - t) * a->ry + s * b->ry;
+	float rz = (1 - t) * a->rz + s * b->rz;
+	float rw = (1 - t) * a->rw + s * b->rw;
+	float mag = sqrtf(rx * rx + ry * ry + rz * rz + rw * rw);
+	if (mag > 0) {
+		out->rx = rx / mag;
+		out->ry = ry / mag;
+		out->rz = rz / mag;
+		out->rw = rw / mag;
+	} else {
+		out->rx = b->rx;
+		out->ry = b->ry;
+		out->rz = b->rz;
+		out->rw = b->rw;
+	}
+}
+
+void tfSnap(entity_t en) {
+	struct TransformInterp *ti = getComponentOpt(TRANSFORM_INTERP, en);
+	struct Transform *tf = getComponentOpt(TRANSFORM, en);
+	if (ti && tf) {
+		ti->prev = *tf;
+		ti->last = *tf;
+	}
+}
+
+void tfTickEnd(void) {
+	for (struct Transform *tf = clBegin(TRANSFORM); tf; tf = clNext(TRANSFORM, tf)) {
+		struct TransformInterp *ti = getComponentOpt(TRANSFORM_INTERP, tf->entity);
+		if (!ti) {
+			ti = newComponent(TRANSFORM_INTERP, tf->entity);
+			ti->restart = true;
+		}
+		if (ti->restart) {
+			/* New transforms start out still */
+			ti->last = *tf;
+			ti->restart = false;
+		}
+		ti->prev = ti->last;
+		ti->last = *tf;
+	}
+
+	/* Every Transform has one now, any extra belongs to an entity whose Transform was removed */
+	idx_t orphans = clCount(TRANSFORM_INTERP) - clCount(TRANSFORM);
+	if (orphans) {
+		entity_t *ens = stackAlloc(orphans * sizeof(entity_t));
+		unsigned int n = 0;
+		for (struct TransformInterp *ti = clBegin(TRANSFORM_INTERP); ti && n < orphans; ti = clNext(TRANSFORM_INTERP, ti)) {
+			if (!getComponentOpt(TRANSFORM, ti->entity))
+				ens[n++] = ti->entity;
+		}
+		removeComponents(TRANSFORM_INTERP, n, ens);
+		stackDealloc(orphans * sizeof(entity_t));
 	}
 }
 
@@ -62,6 +139,10 @@ static void ichigoNotifier(void *arg, void *component, int type) {
 		ichigoVmNew(NULL, vm, vm->en);
 	} else if (type == NOTIFY_DELETE) {
 		ichigoVmDelete(vm);
+	} else if (type == NOTIFY_SNAPSHOT || type == NOTIFY_RESTORE) {
+		ichigoVmCloneStacks(vm);
+	} else if (type == NOTIFY_SNAPSHOT_FREE) {
+		ichigoVmFreeStacks(vm);
 	} else if (type == NOTIFY_PURGE) {
 		for (vm = clBegin(DRAW_VM_VM); vm; vm = clNext(DRAW_VM_VM, vm)) {
 			ichigoVmDelete(vm);
@@ -114,7 +195,7 @@ static float i_getVarPOS_X(struct IchigoVm *vm) {
 	return tf ? tf->x : 0;
 }
 static void i_setVarPOS_X(struct IchigoVm *vm, float val) {
-	struct Transform *tf = getComponentOpt(TRANSFORM, vm->en);
+	struct Transform *tf = getComponentOptMut(TRANSFORM, vm->en);
 	if (tf)
 		tf->x = val;
 }
@@ -123,7 +204,7 @@ static float i_getVarPOS_Y(struct IchigoVm *vm) {
 	return tf? tf->y : 0;
 }
 static void i_setVarPOS_Y(struct IchigoVm *vm, float val) {
-	struct Transform *tf = getComponentOpt(TRANSFORM, vm->en);
+	struct Transform *tf = getComponentOptMut(TRANSFORM, vm->en);
 	if (tf)
 		tf->y = val;
 }
@@ -132,7 +213,7 @@ static float i_getVarPOS_Z(struct IchigoVm *vm) {
 	return tf ? tf->z : 0;
 }
 static void i_setVarPOS_Z(struct IchigoVm *vm, float val) {
-	struct Transform *tf = getComponentOpt(TRANSFORM, vm->en);
+	struct Transform *tf = getComponentOptMut(TRANSFORM, vm->en);
 	if (tf)
 		tf->z = val;
 }
@@ -402,6 +483,8 @@ void basicsInit(void) {
 
 	componentListInit(TRANSFORM, struct Transform);
 	setNotifier(TRANSFORM, newTransform, NULL);
+	componentListTrackChanges(TRANSFORM, true);
+	componentListInit(TRANSFORM_INTERP, struct TransformInterp);
 
 	addUpdate(UPDATE_NORM, updateVms, NULL);
 
@@ -414,6 +497,7 @@ void basicsInit(void) {
 
 void basicsFini(void) {
 	removeUpdate(UPDATE_NORM, updateVms);
+	componentListFini(TRANSFORM_INTERP);
 	componentListFini(TRANSFORM);
 	componentListFini(ICHIGO_LOCALS);
 	componentListFini(ICHIGO_VM);
@@ -1,35 +1,117 @@
+#define MEM_TAG MEM_TAG_ECS
 #include <ecs.h>
 #include <assets.h>
 #include <mem.h>
 #include <string.h>
+#include <stdlib.h>
 #include <main.h>
 
 #define DENSE_PAGE_SIZE 1024
 #define DENSE_PAGELIST_SIZE (MAX_ENTITY / DENSE_PAGE_SIZE)
 #define SPARSE_NONE ((idx_t)-1)
 
+/* Sparse indices are split into pages that are only allocated once an entity in their ID range gets a component */
+#define SPARSE_PAGE_SHIFT 10
+#define SPARSE_PAGE_SIZE (1 << SPARSE_PAGE_SHIFT)
+#define SPARSE_PAGE_MASK (SPARSE_PAGE_SIZE - 1)
+#define SPARSE_PAGELIST_SIZE (MAX_ENTITY / SPARSE_PAGE_SIZE)
+
+/* The entity table grows one page at a time as IDs are handed out */
+#define ENTITY_PAGE_SHIFT 12
+#define ENTITY_PAGE_SIZE (1 << ENTITY_PAGE_SHIFT)
+#define ENTITY_PAGE_MASK (ENTITY_PAGE_SIZE - 1)
+#define ENTITY_PAGELIST_SIZE (MAX_ENTITY / ENTITY_PAGE_SIZE)
+
+/* ID field values of entity table entries */
+#define ENTITY_ALIVE (MAX_ENTITY - 1)
+#define ENTITY_FREE_END (MAX_ENTITY - 2)
+
+/* Minimum size of a command buffer staging block */
+#define CMD_BLOCK_SIZE (16 * 1024)
+
+/* How many entities ahead a view starts fetching the joined components */
+#define CL_VIEW_PREFETCH 8
+
+#ifdef _MSC_VER
+#include <xmmintrin.h>
+#define prefetch(p) _mm_prefetch((const char *)(p), _MM_HINT_T0)
+#else
+#define prefetch(p) __builtin_prefetch(p)
+#endif
+
 struct ComponentList {
 	bool initialized;
 	bool noPurge;
 	bool deletedComponent;
 	bool keepOrdering;
+	bool trackChanges;
+	bool noSnapshot;
+	bool bulkRemove; /* removeComponents is running, removals from its notifier calls only leave holes */
 
 	unsigned int componentSize;
+	unsigned int nestedHoles; /* Holes left by those removals */
 	unsigned int count;
+	size_t pageSize; /* Bytes in a dense page, including the end of page marker and field arrays */
+
+	/* Structure-of-arrays lists: the dense slot only holds the entity, fields live in arrays after the slots */
+	unsigned int nFields;
+	unsigned int fieldBytes; /* Sum of the field sizes */
+	unsigned int fieldSize[CL_SOA_MAX_FIELDS];
+	unsigned int fieldOffset[CL_SOA_MAX_FIELDS];
+
 	unsigned int nDensePages;
+	unsigned int nSparsePages; /* High-water mark of allocated sparse pages */
 
 	/* Create/delete notifier */
 	void (*notifier)(void *arg, void *component, int type);
 	void *arg;
 
-	idx_t *sparse;
+	idx_t *sparse[SPARSE_PAGELIST_SIZE];
 	void *dense[DENSE_PAGELIST_SIZE];
+	uint32_t *changed[DENSE_PAGELIST_SIZE]; /* Change tick of every dense slot, only if trackChanges is set */
 };
 static struct ComponentList componentLists[MAX_COMPONENTLIST];
 
+/* Shared page for unallocated sparse ranges, always filled with SPARSE_NONE so lookups never need a NULL check */
+static idx_t sparseNonePage[SPARSE_PAGE_SIZE];
+
+/*
+ * Entity table: list holds the version of an alive entity or the next free ID,
+ * componentLists holds two words per entity with a bit for every list it has a component in
+ */
+struct EntityPage {
+	entity_t list[ENTITY_PAGE_SIZE];
+	uint64_t componentLists[ENTITY_PAGE_SIZE * 2];
+};
+static struct EntityPage *entityPages[ENTITY_PAGELIST_SIZE];
+static unsigned int nEntityPages; /* Pages are kept until exit, so this follows the peak entity count */
+
 uint32_t firstFreeEntity;
-entity_t entityList[MAX_ENTITY];
-uint64_t entityComponentLists[MAX_ENTITY * 2];
+
+/* IDs at or above this have not been handed out since the last scene end */
+static uint32_t entityHighWater;
+
+/* Tick written into the change version of modified components */
+static uint32_t changeTick = 1;
+
+static inline entity_t *entityAt(uint32_t idx) {
+	return &entityPages[idx >> ENTITY_PAGE_SHIFT]->list[idx & ENTITY_PAGE_MASK];
+}
+
+static inline uint64_t *entityListsAt(uint32_t idx) {
+	return &entityPages[idx >> ENTITY_PAGE_SHIFT]->componentLists[(idx & ENTITY_PAGE_MASK) * 2];
+}
+
+/* Make sure the entity table covers IDs up to (not including) end */
+static void entityReserve(uint32_t end) {
+	unsigned int nPages = (end + ENTITY_PAGE_SIZE - 1) >> ENTITY_PAGE_SHIFT;
+	for (; nEntityPages < nPages; nEntityPages++) {
+		entityPages[nEntityPages] = globalAlloc(sizeof(struct EntityPage));
+	}
+}
+
+static ParallelForFunc *parallelFor;
+static int (*threadIndex)(void);
 
 
 void componentListInitSz(int id, unsigned int elementSize) {
@@ -38,32 +120,168 @@ void componentListInitSz(int id, unsigned int elementSize) {
 	cl->initialized = true;
 	cl->notifier = NULL;
 	cl->componentSize = elementSize;
+	cl->pageSize = (size_t)DENSE_PAGE_SIZE * elementSize + sizeof(entity_t);
 
-	cl->sparse = globalAlloc(sizeof(idx_t) * MAX_ENTITY);
-	for (unsigned int i = 0; i < MAX_ENTITY; i++) {
-		cl->sparse[i] = SPARSE_NONE;
+	for (unsigned int i = 0; i < SPARSE_PAGELIST_SIZE; i++) {
+		cl->sparse[i] = sparseNonePage;
 	}
 
 	logDebug("New component list (%d)\n", id);
 }
 
+void componentListInitSoA(int id, unsigned int nFields, const unsigned int *fieldSizes) {
+	if (nFields > CL_SOA_MAX_FIELDS) {
+		fail("componentListInitSoA: Too many fields for list %d\n", id);
+	}
+	componentListInitSz(id, sizeof(entity_t));
+	struct ComponentList *cl = &componentLists[id];
+	cl->nFields = nFields;
+
+	/* Every field array starts 16 byte aligned so it can be loaded with SSE */
+	size_t offset = (cl->pageSize + 15) & ~(size_t)15;
+	for (unsigned int i = 0; i < nFields; i++) {
+		cl->fieldSize[i] = fieldSizes[i];
+		cl->fieldOffset[i] = (unsigned int)offset;
+		cl->fieldBytes += fieldSizes[i];
+		offset += ((size_t)DENSE_PAGE_SIZE * fieldSizes[i] + 15) & ~(size_t)15;
+	}
+	cl->pageSize = offset;
+}
+
+static void sparseFreePages(struct ComponentList *cl) {
+	for (unsigned int i = 0; i < cl->nSparsePages; i++) {
+		if (cl->sparse[i] != sparseNonePage) {
+			globalDealloc(cl->sparse[i]);
+			cl->sparse[i] = sparseNonePage;
+		}
+	}
+	cl->nSparsePages = 0;
+}
+
 void componentListFini(int id) {
 	struct ComponentList *cl = &componentLists[id];
 	cl->initialized = false;
 
 	for (unsigned int i = 0; i < cl->nDensePages; i++) {
 		globalDealloc(cl->dense[i]);
+		globalDealloc(cl->changed[i]);
 	}
-	globalDealloc(cl->sparse);
+	sparseFreePages(cl);
 }
 
 static inline entity_t *denseAt(struct ComponentList *cl, idx_t idx) {
 	return (entity_t *)((char *)(cl->dense[idx / DENSE_PAGE_SIZE]) + cl->componentSize * (idx % DENSE_PAGE_SIZE));
 }
 
+static inline void *fieldAt(struct ComponentList *cl, idx_t idx, unsigned int field) {
+	return (char *)cl->dense[idx / DENSE_PAGE_SIZE] + cl->fieldOffset[field] + (size_t)cl->fieldSize[field] * (idx % DENSE_PAGE_SIZE);
+}
+
+/* Dense slot helpers that also cover the field arrays of SoA lists */
+static void slotCopy(struct ComponentList *cl, idx_t dstIdx, idx_t srcIdx) {
+	memcpy(denseAt(cl, dstIdx), denseAt(cl, srcIdx), cl->componentSize);
+	for (unsigned int i = 0; i < cl->nFields; i++) {
+		memcpy(fieldAt(cl, dstIdx, i), fieldAt(cl, srcIdx, i), cl->fieldSize[i]);
+	}
+}
+static void slotZero(struct ComponentList *cl, idx_t idx, idx_t n) {
+	memset(denseAt(cl, idx), 0, (size_t)n * cl->componentSize);
+	for (unsigned int i = 0; i < cl->nFields; i++) {
+		memset(fieldAt(cl, idx, i), 0, (size_t)n * cl->fieldSize[i]);
+	}
+}
+static inline size_t slotSize(struct ComponentList *cl) {
+	return cl->componentSize + cl->fieldBytes;
+}
+static void slotSave(struct ComponentList *cl, idx_t idx, char *buf) {
+	memcpy(buf, denseAt(cl, idx), cl->componentSize);
+	buf += cl->componentSize;
+	for (unsigned int i = 0; i < cl->nFields; i++) {
+		memcpy(buf, fieldAt(cl, idx, i), cl->fieldSize[i]);
+		buf += cl->fieldSize[i];
+	}
+}
+static void slotLoad(struct ComponentList *cl, idx_t idx, const char *buf) {
+	memcpy(denseAt(cl, idx), buf, cl->componentSize);
+	buf += cl->componentSize;
+	for (unsigned int i = 0; i < cl->nFields; i++) {
+		memcpy(fieldAt(cl, idx, i), buf, cl->fieldSize[i]);
+		buf += cl->fieldSize[i];
+	}
+}
+
+static inline idx_t *sparseAt(struct ComponentList *cl, entity_t sparseIdx) {
+	return &cl->sparse[sparseIdx >> SPARSE_PAGE_SHIFT][sparseIdx & SPARSE_PAGE_MASK];
+}
+
+/* Like sparseAt, but allocates the page if needed. Only use this when writing a valid index */
+static idx_t *sparseAtAlloc(struct ComponentList *cl, entity_t sparseIdx) {
+	unsigned int pageIdx = sparseIdx >> SPARSE_PAGE_SHIFT;
+	idx_t **page = &cl->sparse[pageIdx];
+	if (*page == sparseNonePage) {
+		*page = globalAlloc(sizeof(idx_t) * SPARSE_PAGE_SIZE);
+		memset(*page, 0xFF, sizeof(idx_t) * SPARSE_PAGE_SIZE);
+		if (pageIdx >= cl->nSparsePages)
+			cl->nSparsePages = pageIdx + 1;
+	}
+	return &(*page)[sparseIdx & SPARSE_PAGE_MASK];
+}
+
+/* Free dense pages that are past the end of the list */
+static void denseTrim(struct ComponentList *cl) {
+	unsigned int start = (cl->count + DENSE_PAGE_SIZE - 1) / DENSE_PAGE_SIZE;
+	for (unsigned int i = start; i < cl->nDensePages; i++) {
+		if (cl->dense[i]) {
+			globalDealloc(cl->dense[i]);
+			cl->dense[i] = NULL;
+		}
+		if (cl->changed[i]) {
+			globalDealloc(cl->changed[i]);
+			cl->changed[i] = NULL;
+		}
+	}
+	if (start < cl->nDensePages)
+		cl->nDensePages = start;
+}
+
+/* Make sure dense pages exist up to (not including) index end */
+static void denseReserve(struct ComponentList *cl, idx_t end) {
+	unsigned int nPages = (end + DENSE_PAGE_SIZE - 1) / DENSE_PAGE_SIZE;
+	size_t sz = (size_t)DENSE_PAGE_SIZE * cl->componentSize;
+	for (unsigned int i = cl->nDensePages; i < nPages; i++) {
+		char *dense = globalAlloc(cl->pageSize);
+		*(entity_t *)(dense + sz) = (i + 1) << ENTITY_ID_SHIFT;
+		cl->dense[i] = dense;
+		if (cl->trackChanges)
+			cl->changed[i] = globalAlloc(sizeof(uint32_t) * DENSE_PAGE_SIZE);
+	}
+	if (nPages > cl->nDensePages)
+		cl->nDensePages = nPages;
+}
+
+static inline uint32_t *changedAt(struct ComponentList *cl, idx_t idx) {
+	return &cl->changed[idx / DENSE_PAGE_SIZE][idx % DENSE_PAGE_SIZE];
+}
+
+static inline void markChanged(struct ComponentList *cl, idx_t idx) {
+	if (cl->trackChanges)
+		*changedAt(cl, idx) = changeTick;
+}
+
+/* Move a component to a free slot, keeping its sparse index and change tick up to date */
+static void denseMove(struct ComponentList *cl, idx_t dstIdx, idx_t srcIdx) {
+	entity_t *src = denseAt(cl, srcIdx);
+	entity_t *dst = denseAt(cl, dstIdx);
+	slotCopy(cl, dstIdx, srcIdx);
+	*src = 0;
+	*sparseAt(cl, *dst >> ENTITY_ID_SHIFT) = dstIdx;
+	if (cl->trackChanges)
+		*changedAt(cl, dstIdx) = *changedAt(cl, srcIdx);
+}
+
 void *getComponentOpt(int id, entity_t entity) {
 	struct ComponentList *cl = &componentLists[id];
-	idx_t idx = cl->sparse[entity >> ENTITY_ID_SHIFT];
+	idx_t idx = *sparseAt(cl, entity >> ENTITY_ID_SHIFT);
 	if (idx != SPARSE_NONE) {
 		entity_t *ret = denseAt(cl, idx);
 		if (entity == *ret)
@@ -86,29 +304,25 @@ void *newComponent(int id, entity_t entity) {
 	}
 
 	entity_t sparseIdx = entity >> ENTITY_ID_SHIFT;
+	idx_t *sparse = sparseAtAlloc(cl, sparseIdx);
 	idx_t idx;
-	if (cl->sparse[sparseIdx] != SPARSE_NONE) {
+	if (*sparse != SPARSE_NONE) {
 		/* Overwrite existing component if it already exists */
-		idx = cl->sparse[sparseIdx];
+		idx = *sparse;
 		logDebug("Overwriting component %x in list %d\n", entity, id);
 	} else {
 		idx = cl->count;
-		cl->sparse[sparseIdx] = idx;
-		if (idx % DENSE_PAGE_SIZE == 0) {
-			size_t sz = (size_t)DENSE_PAGE_SIZE * cl->componentSize;
-			char *dense = globalAlloc(sz + 4);
-			*(entity_t *)(dense + sz) = ((idx / DENSE_PAGE_SIZE) + 1) << ENTITY_ID_SHIFT;
-			cl->dense[idx / DENSE_PAGE_SIZE] = dense;
-			cl->nDensePages++;
-		}
+		*sparse = idx;
+		denseReserve(cl, idx + 1);
 		cl->count++;
 	}
 	void *ret = denseAt(cl, idx);
-	memset(ret, 0, cl->componentSize);
+	slotZero(cl, idx, 1);
 	*(entity_t *)ret = entity;
+	markChanged(cl, idx);
 
-	/* Set entityComponentLists */
-	entityComponentLists[sparseIdx * 2 + id / 64] |= (1ULL << id % 64);
+	/* Set the list bit of the entity */
+	entityListsAt(sparseIdx)[id / 64] |= (1ULL << id % 64);
 
 	if (cl->notifier) {
 		cl->notifier(cl->arg, ret, NOTIFY_CREATE);
@@ -121,76 +335,287 @@ static void unregEntity(entity_t entity);
 void removeComponent(int id, entity_t entity) {
 	struct ComponentList *cl = &componentLists[id];
 	entity_t sparseIdx = entity >> ENTITY_ID_SHIFT;
-	idx_t idx = cl->sparse[sparseIdx];
+	idx_t *sparse = sparseAt(cl, sparseIdx);
+	idx_t idx = *sparse;
 	if (idx == SPARSE_NONE)
 		return;
 
-	cl->sparse[sparseIdx] = SPARSE_NONE;
-	
 	entity_t *dst = denseAt(cl, idx);
 	if (entity != *dst)
 		return; /* Deleting an older version */
 
+	*sparse = SPARSE_NONE;
+
 	if (cl->notifier)
 		cl->notifier(cl->arg, dst, NOTIFY_DELETE);
 
 	if (cl->keepOrdering) {
 		*dst = 0;
+	} else if (cl->bulkRemove) {
+		*dst = 0;
+		cl->nestedHoles++;
 	} else {
 		cl->count -= 1;
 		if (idx != cl->count) {
 			/* Do swap */
-			entity_t *src = denseAt(cl, cl->count);
-			memcpy(dst, src, cl->componentSize);
-			entity_t swapped = *dst;
-			cl->sparse[swapped >> ENTITY_ID_SHIFT] = idx;
-			*src = 0;
+			denseMove(cl, idx, cl->count);
 		} else {
 			*dst = 0;
 		}
-
-		if (cl->count % DENSE_PAGE_SIZE == 0) {
-			uint32_t i = cl->count / DENSE_PAGE_SIZE;
-			globalDealloc(cl->dense[i]);
-			cl->dense[i] = NULL;
-			cl->nDensePages--;
-		}
+		denseTrim(cl);
 		cl->deletedComponent = true;
 	}
 
-	entityComponentLists[sparseIdx * 2 + id / 64] &= ~(1ULL << id % 64);
-	if (!entityComponentLists[sparseIdx * 2] && !entityComponentLists[sparseIdx * 2 + 1]) {
+	entityListsAt(sparseIdx)[id / 64] &= ~(1ULL << id % 64);
+	if (!entityListsAt(sparseIdx)[0] && !entityListsAt(sparseIdx)[1]) {
 		/* Unregister this entity if it doesnt have any more components */
 		unregEntity(entity);
 	}
 }
+idx_t newComponents(int id, unsigned int n, const entity_t *entities) {
+	struct ComponentList *cl = &componentLists[id];
+	if (!cl->initialized) {
+		fail("newComponents: Invalid component list\n");
+	}
+
+	/* Entities that already have this component are reset in place, the rest is appended */
+	idx_t first = cl->count;
+	unsigned int nNew = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		if (*sparseAt(cl, entities[i] >> ENTITY_ID_SHIFT) == SPARSE_NONE)
+			nNew++;
+	}
+	if (first + nNew > MAX_ENTITY) {
+		fail("newComponents: List %d is full\n", id);
+	}
+	denseReserve(cl, first + nNew);
+
+	/* Zero the appended range one page at a time */
+	for (idx_t idx = first; idx < first + nNew;) {
+		idx_t pageEnd = (idx / DENSE_PAGE_SIZE + 1) * DENSE_PAGE_SIZE;
+		if (pageEnd > first + nNew)
+			pageEnd = first + nNew;
+		slotZero(cl, idx, pageEnd - idx);
+		idx = pageEnd;
+	}
+
+	for (unsigned int i = 0; i < n; i++) {
+		entity_t sparseIdx = entities[i] >> ENTITY_ID_SHIFT;
+		idx_t *sparse = sparseAtAlloc(cl, sparseIdx);
+		entity_t *c;
+		if (*sparse != SPARSE_NONE) {
+			c = denseAt(cl, *sparse);
+			slotZero(cl, *sparse, 1);
+		} else {
+			*sparse = cl->count++;
+			c = denseAt(cl, *sparse);
+		}
+		*c = entities[i];
+		markChanged(cl, *sparse);
+		entityListsAt(sparseIdx)[id / 64] |= (1ULL << id % 64);
+	}
+
+	if (cl->notifier) {
+		for (unsigned int i = 0; i < n; i++) {
+			cl->notifier(cl->arg, denseAt(cl, *sparseAt(cl, entities[i] >> ENTITY_ID_SHIFT)), NOTIFY_CREATE);
+		}
+	}
+	return first;
+}
+
+void removeComponents(int id, unsigned int n, const entity_t *entities) {
+	struct ComponentList *cl = &componentLists[id];
+	idx_t *holes = stackAlloc(n * sizeof(idx_t));
+	unsigned int nHoles = 0;
+
+	/*
+	 * Every notifier call sees the components that are not removed yet, like a series of removeComponent calls.
+	 * Notifiers may remove more components from this list, the outermost call compacts their holes as well.
+	 */
+	bool nested = cl->bulkRemove;
+	cl->bulkRemove = true;
+
+	for (unsigned int i = 0; i < n; i++) {
+		entity_t sparseIdx = entities[i] >> ENTITY_ID_SHIFT;
+		idx_t *sparse = sparseAt(cl, sparseIdx);
+		idx_t idx = *sparse;
+		if (idx == SPARSE_NONE)
+			continue;
+		entity_t *c = denseAt(cl, idx);
+		if (entities[i] != *c)
+			continue; /* Older version */
+
+		*sparse = SPARSE_NONE;
+		if (cl->notifier)
+			cl->notifier(cl->arg, c, NOTIFY_DELETE);
+		*c = 0;
+		holes[nHoles++] = idx;
+
+		entityListsAt(sparseIdx)[id / 64] &= ~(1ULL << id % 64);
+		if (!entityListsAt(sparseIdx)[0] && !entityListsAt(sparseIdx)[1]) {
+			unregEntity(entities[i]);
+		}
+	}
+
+	if (nested || cl->keepOrdering) {
+		if (!cl->keepOrdering)
+			cl->nestedHoles += nHoles;
+	} else if (cl->nestedHoles) {
+		/* Holes are not all known, compact the whole list */
+		componentListOrderedClean(id);
+		cl->deletedComponent = true;
+	} else if (nHoles) {
+		/* Fill the holes below the new end with live components from the tail */
+		idx_t newCount = cl->count - nHoles;
+		idx_t tail = cl->count;
+		for (unsigned int i = 0; i < nHoles; i++) {
+			idx_t hole = holes[i];
+			if (hole >= newCount)
+				continue;
+			do {
+				tail--;
+			} while (!*denseAt(cl, tail));
+			denseMove(cl, hole, tail);
+		}
+		cl->count = newCount;
+		denseTrim(cl);
+		cl->deletedComponent = true;
+	}
+	if (!nested) {
+		cl->bulkRemove = false;
+		cl->nestedHoles = 0;
+	}
+	stackDealloc(n * sizeof(idx_t));
+}
+
 void componentListOrderedClean(int id) {
 	struct ComponentList *cl = &componentLists[id];
 	int srcIdx = 0, dstIdx = 0;
 	for (unsigned int i = 0; i < cl->count; i++) {
-		entity_t *src = denseAt(cl, srcIdx);
-		if (*src) {
-			if (srcIdx != dstIdx) {
-				entity_t *dst = denseAt(cl, dstIdx);
-				memcpy(dst, src, cl->componentSize);
-				*src = 0;
-				cl->sparse[*dst >> ENTITY_ID_SHIFT] = dstIdx;
-			}
+		if (*denseAt(cl, srcIdx)) {
+			if (srcIdx != dstIdx)
+				denseMove(cl, dstIdx, srcIdx);
 			dstIdx++;
 		}
 		srcIdx++;
 	}
 	cl->count = dstIdx;
-	int start = (cl->count / DENSE_PAGE_SIZE);
-	if (cl->count % DENSE_PAGE_SIZE)
-		start++;
-	for (int i = start; i < cl->nDensePages; i++) {
-		if (cl->dense[i]) {
-			globalDealloc(cl->dense[i]);
-			cl->dense[i] = NULL;
+	denseTrim(cl);
+}
+
+/* qsort has no context argument, sorting only happens on the main thread */
+static struct ComponentList *sortList;
+static int (*sortCmp)(const void *a, const void *b);
+
+static int sortCompare(const void *a, const void *b) {
+	idx_t ia = *(const idx_t *)a, ib = *(const idx_t *)b;
+	entity_t *ca = denseAt(sortList, ia), *cb = denseAt(sortList, ib);
+	if (!*ca || !*cb) {
+		/* Holes go to the end */
+		if (*ca != *cb)
+			return *ca ? -1 : 1;
+	} else {
+		int r = sortCmp(ca, cb);
+		if (r)
+			return r;
+	}
+	/* Keep equal components in their current order */
+	return ia < ib ? -1 : 1;
+}
+
+bool componentListSort(int id, int (*cmp)(const void *a, const void *b)) {
+	struct ComponentList *cl = &componentLists[id];
+	idx_t count = cl->count;
+
+	/* Most frames nothing moved, so check first */
+	bool sorted = true;
+	for (idx_t i = 1; i < count && sorted; i++) {
+		entity_t *a = denseAt(cl, i - 1), *b = denseAt(cl, i);
+		sorted = *a && *b && cmp(a, b) <= 0;
+	}
+	if (sorted && (!count || *denseAt(cl, count - 1)))
+		return false;
+
+	idx_t *order = stackAlloc(count * sizeof(idx_t));
+	char *tmp = stackAlloc(slotSize(cl));
+	for (idx_t i = 0; i < count; i++) {
+		order[i] = i;
+	}
+	sortList = cl;
+	sortCmp = cmp;
+	qsort(order, count, sizeof(idx_t), sortCompare);
+
+	/* Apply the permutation one cycle at a time, slot i receives the component at order[i] */
+	for (idx_t i = 0; i < count; i++) {
+		if (order[i] == i)
+			continue;
+		uint32_t tmpTick = cl->trackChanges ? *changedAt(cl, i) : 0;
+		slotSave(cl, i, tmp);
+		idx_t j = i;
+		while (order[j] != i) {
+			idx_t k = order[j];
+			slotCopy(cl, j, k);
+			if (cl->trackChanges)
+				*changedAt(cl, j) = *changedAt(cl, k);
+			order[j] = j;
+			j = k;
 		}
+		slotLoad(cl, j, tmp);
+		if (cl->trackChanges)
+			*changedAt(cl, j) = tmpTick;
+		order[j] = j;
 	}
-	cl->nDensePages = start;
+
+	idx_t live = 0;
+	for (idx_t i = 0; i < count; i++) {
+		entity_t en = *denseAt(cl, i);
+		if (en) {
+			*sparseAt(cl, en >> ENTITY_ID_SHIFT) = i;
+			live = i + 1;
+		}
+	}
+	cl->count = live;
+	denseTrim(cl);
+
+	stackDealloc(slotSize(cl));
+	stackDealloc(count * sizeof(idx_t));
+	return true;
+}
+
+static void denseSwap(struct ComponentList *cl, idx_t a, idx_t b, void *tmp) {
+	entity_t *ca = denseAt(cl, a), *cb = denseAt(cl, b);
+	slotSave(cl, a, tmp);
+	slotCopy(cl, a, b);
+	slotLoad(cl, b, tmp);
+	if (*ca)
+		*sparseAt(cl, *ca >> ENTITY_ID_SHIFT) = a;
+	if (*cb)
+		*sparseAt(cl, *cb >> ENTITY_ID_SHIFT) = b;
+	if (cl->trackChanges) {
+		uint32_t t = *changedAt(cl, a);
+		*changedAt(cl, a) = *changedAt(cl, b);
+		*changedAt(cl, b) = t;
+	}
+}
+
+idx_t componentListGroup(int id, int leader) {
+	struct ComponentList *cl = &componentLists[id];
+	struct ComponentList *lead = &componentLists[leader];
+	void *tmp = stackAlloc(slotSize(cl));
+	idx_t n = 0;
+	for (idx_t i = 0; i < lead->count; i++) {
+		entity_t en = *denseAt(lead, i);
+		if (!en)
+			continue;
+		idx_t idx = *sparseAt(cl, en >> ENTITY_ID_SHIFT);
+		if (idx == SPARSE_NONE || *denseAt(cl, idx) != en)
+			continue;
+		if (idx != n)
+			denseSwap(cl, idx, n, tmp);
+		n++;
+	}
+	stackDealloc(slotSize(cl));
+	return n;
 }
 
 idx_t clCount(int id) {
@@ -202,6 +627,22 @@ void *clAt(int id, idx_t idx) {
 	return denseAt(cl, idx);
 }
 
+void *clField(int id, const void *component, unsigned int field) {
+	struct ComponentList *cl = &componentLists[id];
+	idx_t idx = *sparseAt(cl, *(const entity_t *)component >> ENTITY_ID_SHIFT);
+	return fieldAt(cl, idx, field);
+}
+void *clFieldPage(int id, unsigned int page, unsigned int field, idx_t *n) {
+	struct ComponentList *cl = &componentLists[id];
+	idx_t start = page * DENSE_PAGE_SIZE;
+	if (start >= cl->count) {
+		*n = 0;
+		return NULL;
+	}
+	*n = cl->count - start < DENSE_PAGE_SIZE ? cl->count - start : DENSE_PAGE_SIZE;
+	return fieldAt(cl, start, field);
+}
+
 void *clBegin(int id) {
 	struct ComponentList *cl = &componentLists[id];
 	cl->deletedComponent = false;
@@ -230,6 +671,247 @@ void *clNext(int id, void *it) {
 }
 
 
+struct ParallelForEach {
+	struct ComponentList *cl;
+	void (*fn)(void *arg, void *component);
+	void *arg;
+};
+
+static void clParallelPage(void *arg, unsigned int page) {
+	struct ParallelForEach *pfe = arg;
+	struct ComponentList *cl = pfe->cl;
+	idx_t end = (page + 1) * DENSE_PAGE_SIZE;
+	if (end > cl->count)
+		end = cl->count;
+	char *c = cl->dense[page];
+	for (idx_t i = page * DENSE_PAGE_SIZE; i < end; i++, c += cl->componentSize) {
+		if (*(entity_t *)c)
+			pfe->fn(pfe->arg, c);
+	}
+}
+
+static void serialFor(unsigned int n, void (*fn)(void *arg, unsigned int i), void *arg) {
+	for (unsigned int i = 0; i < n; i++) {
+		fn(arg, i);
+	}
+}
+
+void ecsSetParallelFor(ParallelForFunc *func) {
+	parallelFor = func ? func : serialFor;
+}
+
+void clParallelForEach(int id, void (*fn)(void *arg, void *component), void *arg) {
+	struct ParallelForEach pfe = { &componentLists[id], fn, arg };
+	unsigned int nPages = (pfe.cl->count + DENSE_PAGE_SIZE - 1) / DENSE_PAGE_SIZE;
+	parallelFor(nPages, clParallelPage, &pfe);
+}
+
+
+enum EcsCmdType {
+	CMD_NEW_COMPONENT,
+	CMD_REMOVE_COMPONENT,
+	CMD_DELETE_ENTITY
+};
+struct EcsCmd {
+	enum EcsCmdType type;
+	int id;
+	entity_t entity;
+	void (*init)(void *component, void *data);
+	void *data;
+};
+struct EcsCmdBlock {
+	struct EcsCmdBlock *next;
+	size_t size;
+	size_t used;
+	char *data;
+};
+
+static struct EcsCmdBuffer threadCmds[ECS_MAX_THREADS];
+
+void ecsCmdCreate(struct EcsCmdBuffer *buf) {
+	vecCreate(&buf->cmds, sizeof(struct EcsCmd));
+	buf->blocks = NULL;
+}
+
+void ecsCmdDestroy(struct EcsCmdBuffer *buf) {
+	vecDestroy(&buf->cmds);
+	struct EcsCmdBlock *b = buf->blocks;
+	while (b) {
+		struct EcsCmdBlock *next = b->next;
+		globalDealloc(b);
+		b = next;
+	}
+	buf->blocks = NULL;
+}
+
+static void *cmdStage(struct EcsCmdBuffer *buf, size_t sz) {
+	sz = (sz + 15) & ~(size_t)15;
+	struct EcsCmdBlock *b = buf->blocks;
+	if (!b || b->used + sz > b->size) {
+		/* Blocks are never moved, so staged pointers stay valid until the flush */
+		size_t blockSize = sz > CMD_BLOCK_SIZE ? sz : CMD_BLOCK_SIZE;
+		b = globalAlloc(sizeof(*b) + blockSize + 15);
+		b->next = buf->blocks;
+		b->size = blockSize;
+		b->used = 0;
+		b->data = (char *)(((uintptr_t)(b + 1) + 15) & ~(uintptr_t)15);
+		buf->blocks = b;
+	}
+	void *ret = b->data + b->used;
+	b->used += sz;
+	memset(ret, 0, sz);
+	return ret;
+}
+
+static struct EcsCmd *cmdAdd(struct EcsCmdBuffer *buf, enum EcsCmdType type, int id, entity_t entity) {
+	struct EcsCmd *cmd = vecInsert(&buf->cmds, -1);
+	cmd->type = type;
+	cmd->id = id;
+	cmd->entity = entity;
+	cmd->init = NULL;
+	cmd->data = NULL;
+	return cmd;
+}
+
+void *ecsCmdNewComponent(struct EcsCmdBuffer *buf, int id, entity_t entity,
+	void (*init)(void *component, void *data), size_t dataSize) {
+	struct EcsCmd *cmd = cmdAdd(buf, CMD_NEW_COMPONENT, id, entity);
+	cmd->init = init;
+	if (dataSize)
+		cmd->data = cmdStage(buf, dataSize);
+	return cmd->data;
+}
+
+void ecsCmdRemoveComponent(struct EcsCmdBuffer *buf, int id, entity_t entity) {
+	cmdAdd(buf, CMD_REMOVE_COMPONENT, id, entity);
+}
+
+void ecsCmdDeleteEntity(struct EcsCmdBuffer *buf, entity_t entity) {
+	cmdAdd(buf, CMD_DELETE_ENTITY, 0, entity);
+}
+
+static bool entityAlive(entity_t entity) {
+	entity_t idx = entity >> ENTITY_ID_SHIFT;
+	return idx < entityHighWater && *entityAt(idx) == ((ENTITY_ALIVE << ENTITY_ID_SHIFT) | (entity & ENTITY_VERSION_MASK));
+}
+
+void ecsCmdFlush(struct EcsCmdBuffer *buf) {
+	/* Commands may record more commands into this buffer, so don't hold pointers into it */
+	for (unsigned int i = 0; i < vecCount(&buf->cmds); i++) {
+		struct EcsCmd cmd = *(struct EcsCmd *)vecAt(&buf->cmds, i);
+		/* The entity may have been deleted and its ID reused since the command was recorded */
+		if (!entityAlive(cmd.entity))
+			continue;
+		switch (cmd.type) {
+		case CMD_NEW_COMPONENT:
+		{
+			void *c = newComponent(cmd.id, cmd.entity);
+			if (cmd.init)
+				cmd.init(c, cmd.data);
+			break;
+		}
+		case CMD_REMOVE_COMPONENT:
+			removeComponent(cmd.id, cmd.entity);
+			break;
+		case CMD_DELETE_ENTITY:
+			deleteEntity(cmd.entity);
+			break;
+		}
+	}
+
+	/* Keep the allocations around for the next frame */
+	buf->cmds.nElements = 0;
+	for (struct EcsCmdBlock *b = buf->blocks; b; b = b->next) {
+		b->used = 0;
+	}
+}
+
+struct EcsCmdBuffer *ecsCmdThreadBuffer(void) {
+	/* Only the owning thread touches its slot, so lazy creation needs no lock */
+	struct EcsCmdBuffer *buf = &threadCmds[threadIndex ? threadIndex() : 0];
+	if (!buf->cmds.elementSize)
+		ecsCmdCreate(buf);
+	return buf;
+}
+
+void ecsCmdFlushAll(void) {
+	for (int i = 0; i < ECS_MAX_THREADS; i++) {
+		if (threadCmds[i].cmds.elementSize)
+			ecsCmdFlush(&threadCmds[i]);
+	}
+}
+
+void ecsSetThreadIndex(int (*func)(void)) {
+	threadIndex = func;
+}
+
+
+void clViewInit(struct ComponentView *view, int nLists, const int *ids) {
+	if (nLists > CL_VIEW_MAX) {
+		fail("clViewInit: Too many component lists\n");
+	}
+	view->nLists = nLists;
+	view->driver = 0;
+	view->idx = 0;
+	view->mask[0] = view->mask[1] = 0;
+	for (int i = 0; i < nLists; i++) {
+		view->ids[i] = ids[i];
+		view->mask[ids[i] / 64] |= 1ULL << ids[i] % 64;
+		view->c[i] = NULL;
+		if (componentLists[ids[i]].count < componentLists[ids[view->driver]].count)
+			view->driver = i;
+	}
+}
+
+static void clViewPrefetch(struct ComponentView *view, struct ComponentList *drv, idx_t i) {
+	/* Fetch the bitmask and sparse slots first, the components they point to are fetched a few iterations later */
+	if (i + CL_VIEW_PREFETCH < drv->count) {
+		entity_t sparseIdx = *denseAt(drv, i + CL_VIEW_PREFETCH) >> ENTITY_ID_SHIFT;
+		prefetch(entityListsAt(sparseIdx));
+		for (int k = 0; k < view->nLists; k++) {
+			if (k != view->driver)
+				prefetch(sparseAt(&componentLists[view->ids[k]], sparseIdx));
+		}
+	}
+	if (i + CL_VIEW_PREFETCH / 2 < drv->count) {
+		entity_t sparseIdx = *denseAt(drv, i + CL_VIEW_PREFETCH / 2) >> ENTITY_ID_SHIFT;
+		for (int k = 0; k < view->nLists; k++) {
+			struct ComponentList *cl = &componentLists[view->ids[k]];
+			idx_t idx = *sparseAt(cl, sparseIdx);
+			if (k != view->driver && idx != SPARSE_NONE)
+				prefetch(denseAt(cl, idx));
+		}
+	}
+}
+
+bool clViewNext(struct ComponentView *view) {
+	struct ComponentList *drv = &componentLists[view->ids[view->driver]];
+	while (view->idx < drv->count) {
+		idx_t i = view->idx++;
+		clViewPrefetch(view, drv, i);
+
+		entity_t *en = denseAt(drv, i);
+		if (!*en)
+			continue; /* Deleted from an ordered list */
+		entity_t sparseIdx = *en >> ENTITY_ID_SHIFT;
+		uint64_t *components = entityListsAt(sparseIdx);
+		if ((components[0] & view->mask[0]) != view->mask[0] || (components[1] & view->mask[1]) != view->mask[1])
+			continue;
+
+		for (int k = 0; k < view->nLists; k++) {
+			if (k == view->driver) {
+				view->c[k] = en;
+			} else {
+				struct ComponentList *cl = &componentLists[view->ids[k]];
+				view->c[k] = denseAt(cl, *sparseAt(cl, sparseIdx));
+			}
+		}
+		return true;
+	}
+	return false;
+}
+
+
 void setNotifier(int id, void (*func)(void *arg, void *component, int type), void *arg) {
 	struct ComponentList *cl = &componentLists[id];
 	cl->notifier = func;
@@ -245,6 +927,288 @@ void componentListKeepOrdering(int id, bool keep) {
 	cl->keepOrdering = keep;
 }
 
+void componentListTrackChanges(int id, bool track) {
+	struct ComponentList *cl = &componentLists[id];
+	if (track == cl->trackChanges)
+		return;
+	cl->trackChanges = track;
+	for (unsigned int i = 0; i < cl->nDensePages; i++) {
+		if (track) {
+			/* Everything that already exists counts as changed */
+			cl->changed[i] = globalAlloc(sizeof(uint32_t) * DENSE_PAGE_SIZE);
+			for (unsigned int j = 0; j < DENSE_PAGE_SIZE; j++) {
+				cl->changed[i][j] = changeTick;
+			}
+		} else {
+			globalDealloc(cl->changed[i]);
+			cl->changed[i] = NULL;
+		}
+	}
+}
+
+uint32_t ecsAdvanceChangeTick(void) {
+	return changeTick++;
+}
+
+void clMarkChanged(int id, entity_t entity) {
+	struct ComponentList *cl = &componentLists[id];
+	idx_t idx = *sparseAt(cl, entity >> ENTITY_ID_SHIFT);
+	if (idx != SPARSE_NONE && *denseAt(cl, idx) == entity)
+		markChanged(cl, idx);
+}
+
+void *getComponentOptMut(int id, entity_t entity) {
+	struct ComponentList *cl = &componentLists[id];
+	idx_t idx = *sparseAt(cl, entity >> ENTITY_ID_SHIFT);
+	if (idx != SPARSE_NONE) {
+		entity_t *ret = denseAt(cl, idx);
+		if (entity == *ret) {
+			markChanged(cl, idx);
+			return ret;
+		}
+	}
+	return NULL;
+}
+void *getComponentMut(int id, entity_t entity) {
+	void *ret = getComponentOptMut(id, entity);
+	if (!ret) {
+		fail("Component 0x%x in list %d not found!\n", entity, id);
+	}
+	return ret;
+}
+
+bool clChangedSince(int id, entity_t entity, uint32_t since) {
+	struct ComponentList *cl = &componentLists[id];
+	if (!cl->trackChanges)
+		return true;
+	idx_t idx = *sparseAt(cl, entity >> ENTITY_ID_SHIFT);
+	return idx != SPARSE_NONE && *changedAt(cl, idx) > since;
+}
+
+void *clNextChanged(int id, idx_t *idx, uint32_t since) {
+	struct ComponentList *cl = &componentLists[id];
+	while (*idx < cl->count) {
+		idx_t i = (*idx)++;
+		if ((!cl->trackChanges || *changedAt(cl, i) > since) && *denseAt(cl, i))
+			return denseAt(cl, i);
+	}
+	return NULL;
+}
+
+struct SnapshotList {
+	bool included;
+	unsigned int count;
+	unsigned int nSparsePages;
+	char *dense; /* count components, see densePack */
+	idx_t **sparse; /* nSparsePages pages, NULL for unallocated ones */
+};
+struct EcsSnapshot {
+	uint32_t firstFreeEntity;
+	uint32_t entityHighWater;
+	uint64_t mask[2]; /* Lists in this snapshot */
+	entity_t *entityList;
+	uint64_t *entityComponentLists;
+	struct SnapshotList lists[MAX_COMPONENTLIST];
+};
+
+void componentListAllowSnapshot(int id, bool allow) {
+	struct ComponentList *cl = &componentLists[id];
+	cl->noSnapshot = !allow;
+}
+
+/*
+ * Snapshots store dense pages back to back. AoS pages are packed down to their components,
+ * SoA pages are stored whole since their field arrays sit at fixed offsets.
+ */
+static inline size_t snapshotPageStride(struct ComponentList *cl) {
+	return cl->nFields ? cl->pageSize : (size_t)DENSE_PAGE_SIZE * cl->componentSize;
+}
+static size_t snapshotDenseSize(struct ComponentList *cl, idx_t count) {
+	if (cl->nFields)
+		return (size_t)((count + DENSE_PAGE_SIZE - 1) / DENSE_PAGE_SIZE) * cl->pageSize;
+	return (size_t)count * cl->componentSize;
+}
+
+/* Copy components between dense pages and a snapshot buffer */
+static void densePack(struct ComponentList *cl, char *dst, idx_t count) {
+	size_t stride = snapshotPageStride(cl);
+	for (idx_t i = 0; i < count; i += DENSE_PAGE_SIZE) {
+		idx_t n = count - i < DENSE_PAGE_SIZE ? count - i : DENSE_PAGE_SIZE;
+		size_t bytes = cl->nFields ? cl->pageSize : (size_t)n * cl->componentSize;
+		memcpy(dst + (i / DENSE_PAGE_SIZE) * stride, cl->dense[i / DENSE_PAGE_SIZE], bytes);
+	}
+}
+static void denseUnpack(struct ComponentList *cl, const char *src, idx_t count) {
+	size_t stride = snapshotPageStride(cl);
+	for (idx_t i = 0; i < count; i += DENSE_PAGE_SIZE) {
+		idx_t n = count - i < DENSE_PAGE_SIZE ? count - i : DENSE_PAGE_SIZE;
+		size_t bytes = cl->nFields ? cl->pageSize : (size_t)n * cl->componentSize;
+		memcpy(cl->dense[i / DENSE_PAGE_SIZE], src + (i / DENSE_PAGE_SIZE) * stride, bytes);
+	}
+}
+
+static void snapshotNotify(struct ComponentList *cl, char *pages, size_t stride, idx_t count, int type) {
+	if (!cl->notifier)
+		return;
+	for (idx_t i = 0; i < count; i++) {
+		entity_t *c = (entity_t *)(pages + (i / DENSE_PAGE_SIZE) * stride + (size_t)(i % DENSE_PAGE_SIZE) * cl->componentSize);
+		if (*c)
+			cl->notifier(cl->arg, c, type);
+	}
+}
+
+struct EcsSnapshot *ecsSnapshot(void) {
+	struct EcsSnapshot *snap = globalAlloc(sizeof(*snap));
+	snap->firstFreeEntity = firstFreeEntity;
+	snap->entityHighWater = entityHighWater;
+	snap->entityList = globalAlloc(sizeof(entity_t) * entityHighWater + 1);
+	snap->entityComponentLists = globalAlloc(sizeof(uint64_t) * 2 * entityHighWater + 1);
+	for (uint32_t i = 0; i < entityHighWater; i += ENTITY_PAGE_SIZE) {
+		uint32_t n = entityHighWater - i < ENTITY_PAGE_SIZE ? entityHighWater - i : ENTITY_PAGE_SIZE;
+		memcpy(&snap->entityList[i], entityAt(i), sizeof(entity_t) * n);
+		memcpy(&snap->entityComponentLists[i * 2], entityListsAt(i), sizeof(uint64_t) * 2 * n);
+	}
+
+	for (int id = 0; id < MAX_COMPONENTLIST; id++) {
+		struct ComponentList *cl = &componentLists[id];
+		struct SnapshotList *sl = &snap->lists[id];
+		if (!cl->initialized || cl->noSnapshot)
+			continue;
+		sl->included = true;
+		snap->mask[id / 64] |= 1ULL << id % 64;
+
+		sl->count = cl->count;
+		sl->dense = globalAlloc(snapshotDenseSize(cl, cl->count) + 1);
+		densePack(cl, sl->dense, cl->count);
+
+		sl->nSparsePages = cl->nSparsePages;
+		sl->sparse = globalAlloc(sizeof(idx_t *) * cl->nSparsePages + 1);
+		for (unsigned int i = 0; i < cl->nSparsePages; i++) {
+			if (cl->sparse[i] != sparseNonePage) {
+				sl->sparse[i] = globalAlloc(sizeof(idx_t) * SPARSE_PAGE_SIZE);
+				memcpy(sl->sparse[i], cl->sparse[i], sizeof(idx_t) * SPARSE_PAGE_SIZE);
+			}
+		}
+
+		/* Let components with heap data give the copy its own */
+		snapshotNotify(cl, sl->dense, snapshotPageStride(cl), sl->count, NOTIFY_SNAPSHOT);
+	}
+	return snap;
+}
+
+/*
+ * Lists left out of the snapshot keep their components, except those of entities that did not exist when it was taken.
+ * Their IDs are free again after the restore, so the next newEntity would hand out the same entity_t with them attached.
+ */
+static void restoreDropNewEntities(const struct EcsSnapshot *snap) {
+	for (int id = 0; id < MAX_COMPONENTLIST; id++) {
+		struct ComponentList *cl = &componentLists[id];
+		if (snap->lists[id].included || !cl->initialized || !cl->count)
+			continue;
+		idx_t count = cl->count;
+		entity_t *drop = stackAlloc(count * sizeof(entity_t));
+		unsigned int n = 0;
+		for (idx_t i = 0; i < count; i++) {
+			entity_t en = *denseAt(cl, i);
+			uint32_t idx = en >> ENTITY_ID_SHIFT;
+			if (en && (idx >= snap->entityHighWater ||
+					snap->entityList[idx] != ((ENTITY_ALIVE << ENTITY_ID_SHIFT) | (en & ENTITY_VERSION_MASK))))
+				drop[n++] = en;
+		}
+		removeComponents(id, n, drop);
+		stackDealloc(count * sizeof(entity_t));
+	}
+}
+
+void ecsRestore(const struct EcsSnapshot *snap) {
+	restoreDropNewEntities(snap);
+
+	/* Release the current components first, notifiers may still look at other lists */
+	for (int id = 0; id < MAX_COMPONENTLIST; id++) {
+		struct ComponentList *cl = &componentLists[id];
+		if (!snap->lists[id].included || !cl->notifier)
+			continue;
+		for (idx_t i = 0; i < cl->count; i++) {
+			entity_t *c = denseAt(cl, i);
+			if (*c)
+				cl->notifier(cl->arg, c, NOTIFY_DELETE);
+		}
+	}
+
+	for (int id = 0; id < MAX_COMPONENTLIST; id++) {
+		struct ComponentList *cl = &componentLists[id];
+		const struct SnapshotList *sl = &snap->lists[id];
+		if (!sl->included || !cl->initialized)
+			continue;
+
+		cl->count = sl->count;
+		denseTrim(cl);
+		denseReserve(cl, cl->count);
+		denseUnpack(cl, sl->dense, cl->count);
+		for (idx_t i = cl->count; i % DENSE_PAGE_SIZE; i++) {
+			*denseAt(cl, i) = 0; /* End of list marker */
+		}
+		if (cl->trackChanges) {
+			/* Everything counts as changed, the restored ticks would be older than what systems have seen */
+			for (idx_t i = 0; i < cl->count; i++) {
+				*changedAt(cl, i) = changeTick;
+			}
+		}
+
+		sparseFreePages(cl);
+		for (unsigned int i = 0; i < sl->nSparsePages; i++) {
+			if (sl->sparse[i]) {
+				cl->sparse[i] = globalAlloc(sizeof(idx_t) * SPARSE_PAGE_SIZE);
+				memcpy(cl->sparse[i], sl->sparse[i], sizeof(idx_t) * SPARSE_PAGE_SIZE);
+			}
+		}
+		cl->nSparsePages = sl->nSparsePages;
+		cl->deletedComponent = false;
+	}
+
+	/* Lists that are not in the snapshot keep their bits */
+	uint32_t maxEntity = entityHighWater > snap->entityHighWater ? entityHighWater : snap->entityHighWater;
+	entityReserve(maxEntity);
+	for (uint32_t i = 0; i < maxEntity; i++) {
+		uint64_t *lists = entityListsAt(i);
+		for (int j = 0; j < 2; j++) {
+			uint64_t saved = i < snap->entityHighWater ? snap->entityComponentLists[i * 2 + j] : 0;
+			lists[j] = (lists[j] & ~snap->mask[j]) | (saved & snap->mask[j]);
+		}
+		if (i < snap->entityHighWater)
+			*entityAt(i) = snap->entityList[i];
+	}
+	firstFreeEntity = snap->firstFreeEntity;
+	entityHighWater = snap->entityHighWater;
+
+	for (int id = 0; id < MAX_COMPONENTLIST; id++) {
+		struct ComponentList *cl = &componentLists[id];
+		if (!snap->lists[id].included || !cl->notifier)
+			continue;
+		for (idx_t i = 0; i < cl->count; i += DENSE_PAGE_SIZE) {
+			idx_t n = cl->count - i < DENSE_PAGE_SIZE ? cl->count - i : DENSE_PAGE_SIZE;
+			snapshotNotify(cl, cl->dense[i / DENSE_PAGE_SIZE], 0, n, NOTIFY_RESTORE);
+		}
+	}
+}
+
+void ecsSnapshotFree(struct EcsSnapshot *snap) {
+	for (int id = 0; id < MAX_COMPONENTLIST; id++) {
+		struct SnapshotList *sl = &snap->lists[id];
+		if (!sl->included)
+			continue;
+		snapshotNotify(&componentLists[id], sl->dense, snapshotPageStride(&componentLists[id]), sl->count, NOTIFY_SNAPSHOT_FREE);
+		for (unsigned int i = 0; i < sl->nSparsePages; i++) {
+			globalDealloc(sl->sparse[i]);
+		}
+		globalDealloc(sl->sparse);
+		globalDealloc(sl->dense);
+	}
+	globalDealloc(snap->entityComponentLists);
+	globalDealloc(snap->entityList);
+	globalDealloc(snap);
+}
+
 void componentListEndScene(void) {
 	for (int id = 0; id < 128; id++) {
 		struct ComponentList *cl = &componentLists[id];
@@ -255,44 +1219,46 @@ void componentListEndScene(void) {
 			cl->notifier(cl->arg, NULL, NOTIFY_PURGE);
 		}
 
-		for (unsigned int i = 0; i < cl->nDensePages; i++) {
-			globalDealloc(cl->dense[i]);
-			cl->dense[i] = NULL;
-		}
-		for (unsigned int i = 0; i < MAX_ENTITY; i++) {
-			cl->sparse[i] = SPARSE_NONE;
-		}
-		cl->nDensePages = 0;
 		cl->count = 0;
+		denseTrim(cl);
+		sparseFreePages(cl);
 	}
 
-	for (unsigned int i = 0; i < MAX_ENTITY; i++) {
-		entityList[i] = (i + 1) << ENTITY_ID_SHIFT | 1;
-		entityComponentLists[i * 2] = 0;
-		entityComponentLists[i * 2 + 1] = 0;
+	/* Only IDs below the high-water mark can have been used in this scene,
+	 * entity table entries above it are initialized when they are handed out */
+	for (uint32_t i = 0; i < entityHighWater; i += ENTITY_PAGE_SIZE) {
+		uint32_t n = entityHighWater - i < ENTITY_PAGE_SIZE ? entityHighWater - i : ENTITY_PAGE_SIZE;
+		memset(entityListsAt(i), 0, sizeof(uint64_t) * 2 * n);
 	}
-	firstFreeEntity = 0;
+	firstFreeEntity = ENTITY_FREE_END;
+	entityHighWater = 0;
 }
 
 
 entity_t newEntity(void) {
-	if (firstFreeEntity == MAX_ENTITY) {
-		fail("Entity limit reached");
-	}
-	entity_t *en = &entityList[firstFreeEntity];
-	entity_t ret = (firstFreeEntity << ENTITY_ID_SHIFT) | (*en & ENTITY_VERSION_MASK);
-	if (firstFreeEntity == *en >> ENTITY_ID_SHIFT) {
-		logNorm("ECS Error\n");
+	uint32_t idx = firstFreeEntity;
+	entity_t *en;
+	if (idx != ENTITY_FREE_END) {
+		/* Reuse a deleted ID */
+		en = entityAt(idx);
+		firstFreeEntity = *en >> ENTITY_ID_SHIFT;
+	} else {
+		if (entityHighWater == ENTITY_FREE_END) {
+			fail("Entity limit reached");
+		}
+		idx = entityHighWater++;
+		entityReserve(entityHighWater);
+		en = entityAt(idx);
+		*en = 1; /* First version */
 	}
-	//logDebug("New: %d\n", firstFreeEntity);
-	firstFreeEntity = *en >> ENTITY_ID_SHIFT;
-	*en = ((MAX_ENTITY - 1) << ENTITY_ID_SHIFT) | (*en & ENTITY_VERSION_MASK);
-	return ret;
+	//logDebug("New: %d\n", idx);
+	*en = (ENTITY_ALIVE << ENTITY_ID_SHIFT) | (*en & ENTITY_VERSION_MASK);
+	return (idx << ENTITY_ID_SHIFT) | (*en & ENTITY_VERSION_MASK);
 }
 
 static void unregEntity(entity_t entity) {
 	idx_t idx = entity >> ENTITY_ID_SHIFT;
-	entity_t *en = &entityList[idx];
+	entity_t *en = entityAt(idx);
 
 	//logDebug("Del: %d\n", idx);
 
@@ -303,10 +1269,60 @@ static void unregEntity(entity_t entity) {
 	firstFreeEntity = idx;
 }
 
+void newEntities(unsigned int n, entity_t *out) {
+	unsigned int i = 0;
+	while (i < n && firstFreeEntity != ENTITY_FREE_END) {
+		out[i++] = newEntity();
+	}
+
+	/* Hand out the rest as one range of fresh IDs */
+	if (entityHighWater + (n - i) > ENTITY_FREE_END) {
+		fail("Entity limit reached");
+	}
+	entityReserve(entityHighWater + (n - i));
+	for (; i < n; i++) {
+		uint32_t idx = entityHighWater++;
+		*entityAt(idx) = (ENTITY_ALIVE << ENTITY_ID_SHIFT) | 1;
+		out[i] = (idx << ENTITY_ID_SHIFT) | 1;
+	}
+}
+
+void deleteEntities(unsigned int n, const entity_t *entities) {
+	entity_t *alive = stackAlloc(n * sizeof(entity_t));
+	entity_t *inList = stackAlloc(n * sizeof(entity_t));
+	unsigned int nAlive = 0;
+	uint64_t lists[2] = { 0, 0 };
+	for (unsigned int i = 0; i < n; i++) {
+		idx_t idx = entities[i] >> ENTITY_ID_SHIFT;
+		if (idx >= entityHighWater || *entityAt(idx) != ((ENTITY_ALIVE << ENTITY_ID_SHIFT) | (entities[i] & ENTITY_VERSION_MASK)))
+			continue;
+		alive[nAlive++] = entities[i];
+		lists[0] |= entityListsAt(idx)[0];
+		lists[1] |= entityListsAt(idx)[1];
+	}
+
+	/* One bulk removal per component list that any of the entities is in */
+	for (int id = 0; id < MAX_COMPONENTLIST; id++) {
+		if (!(lists[id / 64] & (1ULL << id % 64)))
+			continue;
+		unsigned int nInList = 0;
+		for (unsigned int i = 0; i < nAlive; i++) {
+			if (entityListsAt(alive[i] >> ENTITY_ID_SHIFT)[id / 64] & (1ULL << id % 64))
+				inList[nInList++] = alive[i];
+		}
+		removeComponents(id, nInList, inList);
+	}
+
+	stackDealloc(n * sizeof(entity_t));
+	stackDealloc(n * sizeof(entity_t));
+}
+
 void deleteEntity(entity_t entity) {
 	idx_t idx = entity >> ENTITY_ID_SHIFT;
-	entity_t *en = &entityList[idx];
-	if (*en >> ENTITY_ID_SHIFT != MAX_ENTITY - 1)
+	if (idx >= entityHighWater)
+		return; /* Entity doesnt exist */
+	entity_t *en = entityAt(idx);
+	if (*en >> ENTITY_ID_SHIFT != ENTITY_ALIVE)
 		return; /* Entity doesnt exist */
 	if ((*en & ENTITY_VERSION_MASK) != (entity & ENTITY_VERSION_MASK)) {
 		return; /* Entity already has a new version */
@@ -314,7 +1330,7 @@ void deleteEntity(entity_t entity) {
 	
 
 	/* Delete components */
-	uint64_t *components = &entityComponentLists[idx * 2];
+	uint64_t *components = entityListsAt(idx);
 	for (int i = 0; i < 2; i++) {
 		for (int j = 0; components[i] && j < 64; j++) {
 			if (components[i] & (1ULL << j)) {
@@ -325,7 +1341,10 @@ void deleteEntity(entity_t entity) {
 }
 
 void ecsInit(void) {
-	for (unsigned int i = 0; i < MAX_ENTITY; i++) {
-		entityList[i] = (i + 1) << ENTITY_ID_SHIFT | 1;
+	for (unsigned int i = 0; i < SPARSE_PAGE_SIZE; i++) {
+		sparseNonePage[i] = SPARSE_NONE;
 	}
+	firstFreeEntity = ENTITY_FREE_END;
+	entityHighWater = 0;
+	parallelFor = serialFor;
 }
\ No newline at end of file
@@ -10,14 +10,21 @@
 #include <string.h>
 #include <assets.h>
 #include <gfx/draw.h>
+#include <basics.h>
+#include <jobs.h>
+#include <prof.h>
 
 #define LOAD_FRAMES 4
+#define MAX_TICKS_PER_FRAME 4 /* After a longer hitch the game slows down instead of catching up */
+#define UPDATE_ACCESS_WORDS ((MAX_COMPONENTLIST + 63) / 64)
 
 /* Public vars */
 float deltaTime;
+float tickAlpha;
 float fps;
 float frameTimeMs;
 struct UpdateTiming updateTiming;
+struct MemTagStats updateMemory[MEM_TAG_COUNT];
 float gameSpeed = 1;
 
 const char *sceneName;
@@ -32,6 +39,39 @@ struct EvCallback {
 	};
 	void *arg;
 	int typeMask;
+
+	/* Update functions only */
+	bool declared; /* Added with addUpdateAccess, otherwise the function conflicts with everything */
+	unsigned int pass; /* Last updatePass the function ran in */
+	uint64_t reads[UPDATE_ACCESS_WORDS];
+	uint64_t writes[UPDATE_ACCESS_WORDS];
+};
+
+/*
+ * Update functions grouped into waves. Each function is in the wave after the last earlier function
+ * it conflicts with, so the functions in a wave can run at the same time.
+ */
+struct UpdateSchedule {
+	struct Vector order; /* unsigned int indices into the update list, wave by wave */
+	struct Vector waveEnds; /* unsigned int, end of each wave in order */
+	bool dirty;
+	uint64_t work, wall; /* Summed over the frame */
+	float parallelism; /* Of the last frame */
+};
+
+/*
+ * Copied out of the update list before a wave runs, callbacks can add or remove updates
+ * which moves or frees the list entries
+ */
+struct UpdateTask {
+	void (*update)(void *arg);
+	void *arg;
+	uint64_t time;
+};
+
+struct UpdateWave {
+	const char *name;
+	struct UpdateTask *tasks;
 };
 
 struct DrawUpdate {
@@ -41,6 +81,8 @@ struct DrawUpdate {
 };
 
 static struct Vector updateLists[NROF_UPDATES];
+static struct UpdateSchedule schedules[NROF_UPDATES];
+static unsigned int updatePass;
 static struct Vector inputHandlers;
 
 static struct Vector drawUpdates;
@@ -53,6 +95,9 @@ void sceneEnd(void);
 static void doSwitchScene(void);
 
 static uint64_t tickInterval;
+static uint64_t tickAccum; /* Time not simulated yet */
+static uint64_t tickLast;
+static bool tickResync = true;
 
 static void (*loadStart)(void *arg, int prefade);
 static void (*loadEnd)(void *arg);
@@ -63,21 +108,132 @@ static uint64_t loadTickAccum;
 
 extern void physicsUpdate(void);
 
-static void notify(struct Vector *vec, struct Event *ev, bool update) {
+static void notify(struct Vector *vec, struct Event *ev) {
 	for (unsigned int i = 0; i < vecCount(vec); i++) {
 		struct EvCallback *ec = vecAt(vec, i);
-		if (update) {
-			ec->update(ec->arg);
-		} else if (ec->typeMask & ev->type) {
+		if (ec->typeMask & ev->type) {
 			ec->input(ec->arg, ev);
 		}
 	}
 }
 
+static bool updateConflict(const struct EvCallback *a, const struct EvCallback *b) {
+	if (!a->declared || !b->declared)
+		return true;
+	for (int i = 0; i < UPDATE_ACCESS_WORDS; i++) {
+		if ((a->writes[i] & (b->reads[i] | b->writes[i])) || (b->writes[i] & a->reads[i]))
+			return true;
+	}
+	return false;
+}
+
+static void buildSchedule(int type) {
+	struct Vector *list = &updateLists[type];
+	struct UpdateSchedule *s = &schedules[type];
+	unsigned int n = vecCount(list);
+	unsigned int *waveOf = stackAlloc((n + 1) * sizeof(unsigned int));
+	unsigned int nWaves = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		struct EvCallback *ec = vecAt(list, i);
+		waveOf[i] = 0;
+		for (unsigned int j = 0; j < i; j++) {
+			if (waveOf[j] >= waveOf[i] && updateConflict(ec, vecAt(list, j)))
+				waveOf[i] = waveOf[j] + 1;
+		}
+		if (waveOf[i] >= nWaves)
+			nWaves = waveOf[i] + 1;
+	}
+
+	vecClear(&s->order);
+	vecClear(&s->waveEnds);
+	vecReserve(&s->order, n);
+	vecReserve(&s->waveEnds, nWaves);
+	for (unsigned int w = 0; w < nWaves; w++) {
+		for (unsigned int i = 0; i < n; i++) {
+			if (waveOf[i] == w)
+				*(unsigned int *)vecInsert(&s->order, -1) = i;
+		}
+		*(unsigned int *)vecInsert(&s->waveEnds, -1) = vecCount(&s->order);
+	}
+	stackDealloc((n + 1) * sizeof(unsigned int));
+	s->dirty = false;
+}
+
+static void runUpdateTask(void *arg, unsigned int i) {
+	struct UpdateWave *wave = arg;
+	struct UpdateTask *task = &wave->tasks[i];
+	PROF_BEGIN_FN(wave->name, task->update);
+	uint64_t t = SDL_GetPerformanceCounter();
+	task->update(task->arg);
+	task->time = SDL_GetPerformanceCounter() - t;
+	PROF_END();
+}
+
+static const char *updateNames[NROF_UPDATES] = { "phys", "norm", "late", "ui" };
+
+static void runUpdates(int type) {
+	struct Vector *list = &updateLists[type];
+	struct UpdateSchedule *s = &schedules[type];
+	uint64_t start = SDL_GetPerformanceCounter();
+	uint64_t work = 0;
+	unsigned int pass = ++updatePass;
+	unsigned int w = 0, begin = 0;
+
+	if (s->dirty)
+		buildSchedule(type);
+	while (w < vecCount(&s->waveEnds)) {
+		unsigned int end = *(unsigned int *)vecAt(&s->waveEnds, w);
+		size_t sz = (end - begin) * sizeof(struct UpdateTask);
+		struct UpdateWave wave = { updateNames[type], stackAlloc(sz) };
+		bool declared = false;
+		unsigned int n = 0;
+		/* After functions were added or removed during this pass the schedule is rebuilt, skip the ones that ran */
+		for (unsigned int i = begin; i < end; i++) {
+			unsigned int idx = *(unsigned int *)vecAt(&s->order, i);
+			struct EvCallback *ec = vecAt(list, idx);
+			if (ec->pass != pass) {
+				ec->pass = pass;
+				declared = ec->declared;
+				wave.tasks[n].update = ec->update;
+				wave.tasks[n].arg = ec->arg;
+				wave.tasks[n].time = 0;
+				n++;
+			}
+		}
+
+		/* Undeclared functions always run alone, on the main thread */
+		if (n == 1) {
+			runUpdateTask(&wave, 0);
+		} else if (n > 1) {
+			jobsParallelFor(n, runUpdateTask, &wave);
+		}
+		if (declared)
+			ecsCmdFlushAll();
+		for (unsigned int i = 0; i < n; i++) {
+			work += wave.tasks[i].time;
+		}
+		stackDealloc(sz);
+
+		if (s->dirty) {
+			buildSchedule(type);
+			w = 0;
+			begin = 0;
+		} else {
+			begin = end;
+			w++;
+		}
+	}
+
+	s->work += work;
+	s->wall += SDL_GetPerformanceCounter() - start;
+}
 
 void eventInit(void) {
 	for (int i = 0; i < NROF_UPDATES; i++) {
 		vecCreate(&updateLists[i], sizeof(struct EvCallback));
+		vecCreate(&schedules[i].order, sizeof(unsigned int));
+		vecCreate(&schedules[i].waveEnds, sizeof(unsigned int));
+		schedules[i].dirty = true;
 	}
 	vecCreate(&inputHandlers, sizeof(struct EvCallback));
 	vecCreate(&drawUpdates, sizeof(struct DrawUpdate));
@@ -107,31 +263,68 @@ static void eventDrawUpdate(void) {
 	for (unsigned int i = 0; i < vecCount(&drawUpdates); i++) {
 		struct DrawUpdate *upd = vecAt(&drawUpdates, i);
 		if (upd->draw) {
+			PROF_BEGIN_FN("draw", upd->draw);
 			drawReset();
 			upd->draw(upd->arg);
+			PROF_END();
 		}
 	}
 }
 
 static void eventMainUpdate(void) {
-	doSwitchScene();
-
-	/* Update */
 	uint64_t start = SDL_GetPerformanceCounter();
-	uint64_t phys = start, physEngine = start, norm = start, late = start;
-	if (!eventBlockUpdates) {
-		notify(&updateLists[UPDATE_PHYS], NULL, true);
-		phys = SDL_GetPerformanceCounter();
-		physicsUpdate();
-		physEngine = SDL_GetPerformanceCounter();
-		notify(&updateLists[UPDATE_NORM], NULL, true);
-		norm = SDL_GetPerformanceCounter();
-		notify(&updateLists[UPDATE_LATE], NULL, true);
-		late = SDL_GetPerformanceCounter();
+	if (tickResync) {
+		/*
+		 * Keep the accumulator half a tick ahead of the tick boundary, so when drawing at the tick rate
+		 * timing jitter does not make frames alternate between zero and two ticks
+		 */
+		tickAccum = tickInterval + tickInterval / 2;
+		tickResync = false;
+	} else {
+		tickAccum += start - tickLast;
 	}
+	tickLast = start;
+	if (tickAccum > MAX_TICKS_PER_FRAME * tickInterval) {
+		tickAccum = MAX_TICKS_PER_FRAME * tickInterval;
+	}
+
+	/* Simulate in fixed ticks */
+	uint64_t phys = 0, physEngine = 0, norm = 0, late = 0, ui = 0;
+	int ticks = 0;
+	while (tickAccum >= tickInterval && !tickResync) {
+		tickAccum -= tickInterval;
+		ticks++;
+		PROF_BEGIN("tick");
+		doSwitchScene();
+
+		uint64_t t0 = SDL_GetPerformanceCounter();
+		uint64_t t1 = t0, t2 = t0, t3 = t0, t4 = t0;
+		if (!eventBlockUpdates) {
+			runUpdates(UPDATE_PHYS);
+			t1 = SDL_GetPerformanceCounter();
+			PROF_BEGIN("physicsUpdate");
+			physicsUpdate();
+			PROF_END();
+			t2 = SDL_GetPerformanceCounter();
+			runUpdates(UPDATE_NORM);
+			t3 = SDL_GetPerformanceCounter();
+			runUpdates(UPDATE_LATE);
+			t4 = SDL_GetPerformanceCounter();
+		}
 
-	notify(&updateLists[UPDATE_UI], NULL, true);
-	uint64_t ui = SDL_GetPerformanceCounter();
+		runUpdates(UPDATE_UI);
+		tfTickEnd();
+		PROF_END();
+		uint64_t t5 = SDL_GetPerformanceCounter();
+
+		phys += t1 - t0;
+		physEngine += t2 - t1;
+		norm += t3 - t2;
+		late += t4 - t3;
+		ui += t5 - t4;
+	}
+	tickAlpha = (float)tickAccum / tickInterval;
+	uint64_t sim = SDL_GetPerformanceCounter();
 
 	/* Do not block draw */
 	eventDrawUpdate();
@@ -139,14 +332,29 @@ static void eventMainUpdate(void) {
 
 //#ifndef RELEASE
 	float freq = SDL_GetPerformanceFrequency() / 1000.0f;
-	updateTiming.phys = (phys - start) / freq;
-	updateTiming.physEngine = (physEngine - phys) / freq;
-	updateTiming.norm = (norm - physEngine) / freq;
-	updateTiming.late = (late - norm) / freq;
-	updateTiming.ui = (ui - late) / freq;
-	updateTiming.draw = (draw - ui) / freq;
+	updateTiming.phys = phys / freq;
+	updateTiming.physEngine = physEngine / freq;
+	updateTiming.norm = norm / freq;
+	updateTiming.late = late / freq;
+	updateTiming.ui = ui / freq;
+	updateTiming.draw = (draw - sim) / freq;
 	updateTiming.total = (draw - start) / freq;
+	updateTiming.ticks = ticks;
 //#endif
+
+	uint64_t work = 0, wall = 0;
+	for (int i = 0; i < NROF_UPDATES; i++) {
+		struct UpdateSchedule *s = &schedules[i];
+		s->parallelism = s->wall ? (float)s->work / s->wall : 1;
+		work += s->work;
+		wall += s->wall;
+		s->work = 0;
+		s->wall = 0;
+	}
+	updateTiming.parallelism = wall ? (float)work / wall : 1;
+
+	frameReset();
+	memTagFrameEnd(updateMemory);
 }
 	
 
@@ -157,21 +365,32 @@ static void doEvent(SDL_Event *sdlEv) {
 		return;
 	}
 	if (inputHandleEvent(&ev, sdlEv)) {
-		notify(&inputHandlers, &ev, false);
+		notify(&inputHandlers, &ev);
 	}
 }
 
 void eventLoop(void) {
 	SDL_Event sdlEv;
-	float tfps = 60; /* Target fps */
 	int vsync = 0;
 	drawSetVsync(vsync);
+
+	/* Draw at the refresh rate of the display, the simulation runs at TICK_RATE regardless */
+	float tfps = TICK_RATE; /* Target fps */
+	SDL_DisplayMode dm;
+	if (!SDL_GetDesktopDisplayMode(0, &dm) && dm.refresh_rate > 0) {
+		tfps = dm.refresh_rate;
+	}
 	
-	deltaTime = 1.0f / tfps;
+	deltaTime = 1.0f / TICK_RATE;
 
 	uint64_t freq = SDL_GetPerformanceFrequency();
-	tickInterval = freq / tfps;
+	tickInterval = freq / TICK_RATE;
+	tickResync = true;
+	uint64_t frameInterval = freq / tfps;
+	pacerInit();
+	frameStatsInit(frameInterval);
 	uint64_t accum = SDL_GetPerformanceCounter();
+	uint64_t frameEnd = accum;
 
 	/* FPS Counter */
 	uint64_t fCntStart = accum;
@@ -189,7 +408,10 @@ void eventLoop(void) {
 			frameTimeMs = fTime / tfps / freq * 1000.0f;
 			fTime = 0;
 		}
+		profFrame();
+		PROF_BEGIN("frame");
 		uint64_t start = SDL_GetPerformanceCounter();
+		bool loading = loadFrames;
 
 		while (SDL_PollEvent(&sdlEv)) {
 			doEvent(&sdlEv);
@@ -203,28 +425,52 @@ void eventLoop(void) {
 			}
 		}
 		
+		PROF_END();
 		uint64_t ticks = SDL_GetPerformanceCounter();
 		fTime += ticks - start;
-		uint64_t next = accum + tickInterval;
-		if (ticks < next) {
-			uint64_t ms = (next - ticks) * 1000 / freq;
-			if (ms > 2ULL) {
-				SDL_Delay(ms - 2ULL);
-			}
-			while (SDL_GetPerformanceCounter() < next) {}
-			accum += tickInterval;
+		uint64_t next = accum + frameInterval;
+		if (pacerWait(next)) {
+			accum = next;
 		}
 		else {
 			accum = ticks;
 		}
+
+		uint64_t end = SDL_GetPerformanceCounter();
+		if (!loading) {
+			frameStatsAdd(end - frameEnd);
+		}
+		frameEnd = end;
 	}
+	if (sceneName) {
+		frameStatsSceneEnd();
+	}
+	pacerFini();
 }
 
 
 void addUpdate(int type, void (*callback)(void *arg), void *arg) {
 	struct EvCallback *ec = vecInsert(&updateLists[type], -1);
+	memset(ec, 0, sizeof(*ec));
 	ec->update = callback;
 	ec->arg = arg;
+	schedules[type].dirty = true;
+}
+
+static void setAccess(uint64_t *mask, const int *lists) {
+	for (; lists && *lists >= 0; lists++) {
+		if (*lists >= MAX_COMPONENTLIST)
+			fail("Update access: invalid component list %d\n", *lists);
+		mask[*lists / 64] |= (uint64_t)1 << (*lists % 64);
+	}
+}
+
+void addUpdateAccess(int type, void (*callback)(void *arg), void *arg, const int *reads, const int *writes) {
+	addUpdate(type, callback, arg);
+	struct EvCallback *ec = vecAt(&updateLists[type], vecCount(&updateLists[type]) - 1);
+	ec->declared = true;
+	setAccess(ec->reads, reads);
+	setAccess(ec->writes, writes);
 }
 
 void removeUpdate(int type, void (*callback)(void *arg)) {
@@ -232,11 +478,30 @@ void removeUpdate(int type, void (*callback)(void *arg)) {
 		struct EvCallback *ec = vecAt(&updateLists[type], i);
 		if (ec->update == callback) {
 			vecDelete(&updateLists[type], i);
+			schedules[type].dirty = true;
 			break;
 		}
 	}
 }
 
+void eventDumpSchedule(void) {
+	logNorm("Update parallelism %.2f\n", updateTiming.parallelism);
+	for (int type = 0; type < NROF_UPDATES; type++) {
+		struct UpdateSchedule *s = &schedules[type];
+		if (s->dirty)
+			buildSchedule(type);
+		logNorm("%s: %u functions in %u waves, parallelism %.2f\n", updateNames[type], vecCount(&updateLists[type]),
+			vecCount(&s->waveEnds), s->parallelism);
+		unsigned int begin = 0;
+		for (unsigned int w = 0; w < vecCount(&s->waveEnds); w++) {
+			unsigned int end = *(unsigned int *)vecAt(&s->waveEnds, w);
+			struct EvCallback *ec = vecAt(&updateLists[type], *(unsigned int *)vecAt(&s->order, begin));
+			logNorm("  wave %u: %u functions%s\n", w, end - begin, ec->declared ? "" : " (main thread)");
+			begin = end;
+		}
+	}
+}
+
 void addDrawUpdate(int priority, void (*callback)(void *arg), void *arg) {
 	unsigned int i;
 	for (i = 0; i < vecCount(&drawUpdates); i++) {
@@ -337,11 +602,14 @@ static void doSwitchScene(void) {
 	}
 
 	loadFrames = LOAD_FRAMES;
+	/* Loading took time that should not be simulated, start counting ticks again after this one */
+	tickResync = true;
 
 	if (sceneName) {
 		/* End this scene */
+		frameStatsSceneEnd();
 		ev.type = EVENT_END_SCENE;
-		notify(&inputHandlers, &ev, false);
+		notify(&inputHandlers, &ev);
 		componentListEndScene();
 	}
 
@@ -355,8 +623,9 @@ static void doSwitchScene(void) {
 
 	/* Start new scene */
 	sceneName = newSceneName;
+	frameStatsSceneStart(sceneName);
 	ev.type = EVENT_START_SCENE;
-	notify(&inputHandlers, &ev, false);
+	notify(&inputHandlers, &ev);
 
 	doSceneSwitch = false;
 }
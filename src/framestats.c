@@ -0,0 +1,142 @@
+#include "system_events.h"
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <main.h>
+#include <assets.h>
+
+/* Frame times in 0.1ms buckets up to 100ms, the last bucket holds everything longer */
+#define FRAME_HIST_BUCKETS 1000
+#define FRAME_HIST_RES_MS 0.1f
+#define FRAME_STATS_CSV "framestats.csv"
+
+bool frameStatsCsv;
+
+static uint32_t hist[FRAME_HIST_BUCKETS];
+static char scene[32];
+static unsigned int frames;
+static unsigned int hitches;
+static float maxMs;
+static struct UpdateTiming peak;
+static bool skipNext;
+
+static double msPerTick;
+static uint64_t hitchTicks;
+
+void frameStatsInit(uint64_t frameInterval) {
+	msPerTick = 1000.0 / SDL_GetPerformanceFrequency();
+	/* A frame that took the place of two display intervals is a hitch */
+	hitchTicks = frameInterval + frameInterval / 2;
+}
+
+void frameStatsSceneStart(const char *name) {
+	memset(hist, 0, sizeof(hist));
+	snprintf(scene, sizeof(scene), "%s", name);
+	frames = 0;
+	hitches = 0;
+	maxMs = 0;
+	memset(&peak, 0, sizeof(peak));
+	/* The frame that switched scenes includes the loading */
+	skipNext = true;
+}
+
+void frameStatsAdd(uint64_t interval) {
+	if (skipNext) {
+		skipNext = false;
+		return;
+	}
+	float ms = (float)(interval * msPerTick);
+	unsigned int b = (unsigned int)(ms / FRAME_HIST_RES_MS);
+	hist[b < FRAME_HIST_BUCKETS ? b : FRAME_HIST_BUCKETS - 1]++;
+	frames++;
+	if (interval > hitchTicks)
+		hitches++;
+	if (ms > maxMs)
+		maxMs = ms;
+
+#define PEAK(f) if (updateTiming.f > peak.f) peak.f = updateTiming.f
+	PEAK(phys);
+	PEAK(physEngine);
+	PEAK(norm);
+	PEAK(late);
+	PEAK(ui);
+	PEAK(draw);
+	PEAK(total);
+	PEAK(ticks);
+#undef PEAK
+}
+
+/* Upper edge of the bucket that holds the given fraction of frames */
+static float percentile(float p) {
+	uint64_t want = (uint64_t)(p * frames + 0.5f);
+	if (!want)
+		want = 1;
+	uint64_t seen = 0;
+	for (unsigned int b = 0; b < FRAME_HIST_BUCKETS - 1; b++) {
+		seen += hist[b];
+		if (seen >= want) {
+			float ms = (b + 1) * FRAME_HIST_RES_MS;
+			return ms < maxMs ? ms : maxMs;
+		}
+	}
+	return maxMs;
+}
+
+void frameStatsGet(struct FrameStats *stats) {
+	stats->scene = scene;
+	stats->frames = frames;
+	stats->hitches = hitches;
+	stats->p50 = frames ? percentile(0.50f) : 0;
+	stats->p95 = frames ? percentile(0.95f) : 0;
+	stats->p99 = frames ? percentile(0.99f) : 0;
+	stats->max = maxMs;
+	stats->peak = peak;
+}
+
+void frameStatsDump(void) {
+	struct FrameStats s;
+	frameStatsGet(&s);
+	logNorm("Frame times in %s: %u frames p50 %.1fms p95 %.1fms p99 %.1fms max %.1fms, %u hitches\n",
+		s.scene, s.frames, s.p50, s.p95, s.p99, s.max, s.hitches);
+	logNorm("  Phase peaks: phys %.2f physEngine %.2f norm %.2f late %.2f ui %.2f draw %.2f total %.2fms, %d ticks\n",
+		s.peak.phys, s.peak.physEngine, s.peak.norm, s.peak.late, s.peak.ui, s.peak.draw, s.peak.total, s.peak.ticks);
+}
+
+static void frameStatsWriteCsv(const struct FrameStats *s) {
+	char buf[512];
+	snprintf(buf, sizeof(buf), "%s%s", gameUserDir, FRAME_STATS_CSV);
+	SDL_RWops *rw = SDL_RWFromFile(buf, "ab");
+	if (!rw) {
+		logNorm("Cannot write %s: %s\n", buf, SDL_GetError());
+		return;
+	}
+	int len;
+	if (SDL_RWsize(rw) <= 0) {
+		len = snprintf(buf, sizeof(buf), "time,version,scene,frames,hitches,p50_ms,p95_ms,p99_ms,max_ms,"
+			"phys_max,phys_engine_max,norm_max,late_max,ui_max,draw_max,total_max,ticks_max\n");
+		SDL_RWwrite(rw, buf, 1, len);
+	}
+
+	char date[32];
+	time_t now = time(NULL);
+	strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+	const char *version = engineSettings && engineSettings->gameVersion ? engineSettings->gameVersion : "";
+	len = snprintf(buf, sizeof(buf), "%s,%s,%s,%u,%u,%.1f,%.1f,%.1f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f,%d\n",
+		date, version, s->scene, s->frames, s->hitches, s->p50, s->p95, s->p99, s->max,
+		s->peak.phys, s->peak.physEngine, s->peak.norm, s->peak.late, s->peak.ui, s->peak.draw, s->peak.total, s->peak.ticks);
+	SDL_RWwrite(rw, buf, 1, len);
+	SDL_RWclose(rw);
+}
+
+void frameStatsSceneEnd(void) {
+	if (!frames)
+		return;
+	frameStatsDump();
+	if (frameStatsCsv) {
+		struct FrameStats s;
+		frameStatsGet(&s);
+		frameStatsWriteCsv(&s);
+	}
+}
@@ -1,3 +1,4 @@
+#define MEM_TAG MEM_TAG_DRAW
 #include <gfx/draw.h>
 #include <events.h>
 #include <assets.h>
@@ -21,31 +22,40 @@ struct LoadedPoseFile *loadPoseFile(const char *name) {
 		fail("Pose file %s not found\n", name);
 		return NULL;
 	}
-	struct LoadedPoseFile *lpf = globalAlloc(a->bufferSize);
-	assetRead(a, lpf, a->bufferSize);
+	struct LoadedPoseFile *lpf = globalAlloc(offsetof(struct LoadedPoseFile, hdr) + a->bufferSize);
+	assetRead(a, &lpf->hdr, a->bufferSize);
 
 	assetClose(a);
 
+	/* Index the animations by name once so lookups are an integer compare */
+	struct PoseFileHeader *h = &lpf->hdr;
+	lpf->animIds = globalAlloc(h->nAnim * (sizeof(strid_t) + sizeof(struct PoseFileAnim *)));
+	lpf->anims = (struct PoseFileAnim **)(lpf->animIds + h->nAnim);
+	struct PoseFileAnim *anim = (struct PoseFileAnim *)((char *)(h + 1) + sizeof(struct PoseFileBone) * h->nBones);
+	for (unsigned int i = 0; i < h->nAnim; i++) {
+		size_t len = 0;
+		while (len < sizeof(anim->name) && anim->name[len]) {
+			len++;
+		}
+		lpf->animIds[i] = strInternLen(anim->name, len);
+		lpf->anims[i] = anim;
+		anim = ((struct PoseFileAnim *)((char *)anim + anim->size));
+	}
+
 	return lpf;
 }
 void deletePoseFile(struct LoadedPoseFile *lpf) {
+	globalDealloc(lpf->animIds);
 	globalDealloc(lpf);
 }
 
-static struct PoseFileAnim *getAnim(struct PoseFileHeader *h, const char *animName) {
-	struct PoseFileAnim *a = (struct PoseFileAnim *)((char *)(h + 1) + sizeof(struct PoseFileBone) * h->nBones);
-	bool found = false;
-	for (unsigned int i = 0; i < h->nAnim; i++) {
-		if (!strcmp(a->name, animName)) {
-			found = true;
-			break;
+static struct PoseFileAnim *getAnim(struct LoadedPoseFile *lpf, strid_t animName) {
+	for (unsigned int i = 0; i < lpf->hdr.nAnim; i++) {
+		if (lpf->animIds[i] == animName) {
+			return lpf->anims[i];
 		}
-		a = ((struct PoseFileAnim *)((char *)a + a->size));
-	}
-	if (!found) {
-		return NULL;
 	}
-	return a;
+	return NULL;
 }
 
 static void poseFileGet3(Vec *out, int n, struct PoseFileVec3 *v, float time) {
@@ -144,32 +154,45 @@ static void animUpdateState(struct Anim3DState *s, struct PoseFileAnim *a) {
 	}
 }
 
-static void anim3DUpdate(void *arg) {
+static void anim3DUpdateOne(void *arg, void *component) {
 	(void)arg;
-	for (struct Anim3DState *s = clBegin(ANIM_STATE); s; s = clNext(ANIM_STATE, s)) {
-		struct PoseFileHeader *h = &s->poseFile->hdr;
-		struct PoseFileAnim *a = getAnim(h, s->animName);
-		if (!a)
-			continue;
-
-		float spd = s->animSpeed * gameSpeed;
-		s->animTime += spd;
-		if (s->animTime >= a->duration * 60) {
-			if (s->flags & ANIM_FLAG_SINGLE) {
-				s->animTime = a->duration * 60;
-				if (!(s->flags & ANIM_FLAG_ENDED)) {
-					if (s->event)
-						s->event(s);
-					s->flags |= ANIM_FLAG_ENDED;
-				}
-			} else {
-				s->animTime = 0;
-				if (s->event)
-					s->event(s);
+	struct Anim3DState *s = component;
+	struct PoseFileAnim *a = getAnim(s->poseFile, s->animName);
+	if (!a)
+		return;
+
+	float spd = s->animSpeed * gameSpeed;
+	s->animTime += spd;
+	if (s->animTime >= a->duration * 60) {
+		if (s->flags & ANIM_FLAG_SINGLE) {
+			s->animTime = a->duration * 60;
+			if (!(s->flags & ANIM_FLAG_ENDED)) {
+				s->eventPending = true;
+				s->flags |= ANIM_FLAG_ENDED;
 			}
+		} else {
+			s->animTime = 0;
+			s->eventPending = true;
 		}
+	}
+
+	animUpdateState(s, a);
+}
 
-		animUpdateState(s, a);
+static void anim3DUpdate(void *arg) {
+	(void)arg;
+	clParallelForEach(ANIM_STATE, anim3DUpdateOne, NULL);
+}
+
+/* Events can touch anything, so they run in their own undeclared update on the main thread */
+static void anim3DEvents(void *arg) {
+	(void)arg;
+	for (struct Anim3DState *s = clBegin(ANIM_STATE); s; s = clNext(ANIM_STATE, s)) {
+		if (s->eventPending) {
+			s->eventPending = false;
+			if (s->event)
+				s->event(s);
+		}
 	}
 }
 
@@ -200,6 +223,10 @@ static void anim3DNotify(void *arg, void *component, int type) {
 	} else if (type == NOTIFY_DELETE) {
 		globalDealloc(s->mats);
 		s->mats = NULL;
+	} else if (type == NOTIFY_SNAPSHOT) {
+		/* Bone matrices are recalculated on the next update */
+		s->mats = NULL;
+		s->nBones = 0;
 	} else if (type == NOTIFY_PURGE) {
 		for (s = clBegin(ANIM_STATE); s; s = clNext(ANIM_STATE, s)) {
 			globalDealloc(s->mats);
@@ -208,7 +235,7 @@ static void anim3DNotify(void *arg, void *component, int type) {
 }
 
 float anim3DLength(struct Anim3DState *s) {
-	struct PoseFileAnim *a = getAnim(&s->poseFile->hdr, s->animName);
+	struct PoseFileAnim *a = getAnim(s->poseFile, s->animName);
 	if (a) {
 		return a->duration * 60;
 	} else {
@@ -219,9 +246,12 @@ float anim3DLength(struct Anim3DState *s) {
 void anim3DInit(void) {
 	componentListInit(ANIM_STATE, struct Anim3DState);
 	setNotifier(ANIM_STATE, anim3DNotify, NULL);
-	addUpdate(UPDATE_PHYS, anim3DUpdate, NULL);
+	static const int access[] = { ANIM_STATE, -1 };
+	addUpdateAccess(UPDATE_PHYS, anim3DUpdate, NULL, access, access);
+	addUpdate(UPDATE_PHYS, anim3DEvents, NULL);
 }
 void anim3DFini(void) {
+	removeUpdate(UPDATE_PHYS, anim3DEvents);
 	removeUpdate(UPDATE_PHYS, anim3DUpdate);
 	componentListFini(ANIM_STATE);
 }
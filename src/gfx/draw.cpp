@@ -1,3 +1,4 @@
+#define MEM_TAG MEM_TAG_DRAW
 #include <gfx/draw.h>
 #include <SDL2/SDL.h>
 #include <assets.h>
@@ -33,7 +34,7 @@ Mat cam3DMatrix;
 Mat cam3DProjMatrix;
 Vec3 cam3DPos;
 
-static struct HashTable modelTable;
+static struct HashMap modelTable;
 
 
 /*
@@ -302,7 +303,8 @@ void drawEllipse(int nPoints, float w, float h) {
 	float sw2 = drawState.srcW / 2.0f, sh2 = drawState.srcH / 2.0f;
 	float smx = drawState.srcX + sw2, smy = drawState.srcY + sh2; /* Middle point of srcRect */
 
-	unsigned int *indices = static_cast<unsigned int *>(stackAlloc(nPoints * 3 * sizeof(unsigned int)));
+	size_t mark = frameMark();
+	unsigned int *indices = static_cast<unsigned int *>(frameAlloc(nPoints * 3 * sizeof(unsigned int)));
 
 	/* Middle point vertex */
 	drawVertex(0, 0, 0, drawState.srcX + sw2, drawState.srcY + sh2, col[0][0], col[0][1], col[0][2], col[0][3]);
@@ -319,7 +321,7 @@ void drawEllipse(int nPoints, float w, float h) {
 		ang += (2 * PI) / nPoints;
 	}
 	drawIndices(nPoints + 1, nPoints * 3, indices);
-	stackDealloc(nPoints * 3 * sizeof(unsigned int));
+	frameRewind(mark);
 }
 
 void drawArc(int nPoints, float rStart, float r, float w1, float w2) {
@@ -347,7 +349,8 @@ void drawArc(int nPoints, float rStart, float r, float w1, float w2) {
 	ANGLE2C(rr, ri, rStart);
 	ANGLE2C(rdr, rdi, r / nPoints1);
 	unsigned int iSize = nPoints1 * 6 * sizeof(int);
-	unsigned int *ind = static_cast<unsigned int *>(stackAlloc(iSize));
+	size_t mark = frameMark();
+	unsigned int *ind = static_cast<unsigned int *>(frameAlloc(iSize));
 	for (int i = 0; i < nPoints; i++) {
 		float v = lerp(drawState.srcY, drawState.srcY + drawState.srcH, (float)i / nPoints1);
 		drawVertex(rr * w1, ri * w1, 0, drawState.srcX, v, col[0][0], col[0][1], col[0][2], col[0][3]); /* Inner */
@@ -365,7 +368,7 @@ void drawArc(int nPoints, float rStart, float r, float w1, float w2) {
 		CMUL(rr, ri, rr, ri, rdr, rdi);
 	}
 	drawIndices(nPoints * 2, nPoints1 * 6, ind);
-	stackDealloc(iSize);
+	frameRewind(mark);
 }
 
 void drawSkybox(void) {
@@ -504,10 +507,8 @@ int loadModelFile(const char *name) {
 		}
 
 		struct Model *m = new Model;
-		m->en.key = m->name;
 		strncpy(m->name, entry.name, MODEL_NAME_LEN);
 		m->name[MODEL_NAME_LEN - 1] = 0;
-		HTAdd(&modelTable, &m->en);
 		logDebug("Model entry: %s\n", m->name);
 		m->flags = entry.flags;
 		m->nTriangles = entry.nTriangles;
@@ -520,7 +521,7 @@ int loadModelFile(const char *name) {
 		}
 		size_t vboSize = m->nVertices * vboPitch;
 		m->pitch = vboPitch;
-		m->verts = (float *)globalAlloc(vboSize);
+		m->verts = (float *)globalAllocUninit(vboSize);
 		assetRead(a, m->verts, vboSize);
 
 		Vec3 aabbMin{ 999999.0f };
@@ -538,9 +539,19 @@ int loadModelFile(const char *name) {
 		m->aabbHalfExtent = aabbMax - m->aabbCenter;
 
 		size_t eboSize = m->nTriangles * 4ULL * 3;
-		m->indices = (uint32_t *)globalAlloc(eboSize);
+		m->indices = (uint32_t *)globalAllocUninit(eboSize);
 		assetRead(a, m->indices, eboSize);
 
+		uint32_t hash = hashString(m->name);
+		if (hashMapGetHashed(&modelTable, m->name, hash)) {
+			/* The first model loaded under a name is the one getModel returns */
+			logNorm("Duplicate model %s in %s\n", m->name, name);
+			globalDealloc(m->verts);
+			globalDealloc(m->indices);
+			delete m;
+			continue;
+		}
+		hashMapPutHashed(&modelTable, m->name, hash, m);
 		uploadModel(m, m->verts, m->indices);
 	}
 
@@ -550,19 +561,20 @@ closef:
 }
 
 void clearModels(void) {
-	for (unsigned int bu = 0; bu < modelTable.nBuckets; bu++) {
-		struct Model *next = NULL;
-		for (struct Model *m = (struct Model *)modelTable.bu[bu].list.first; m; m = next) {
-			next = (struct Model *)m->en._llEntry.next;
-			HTDelete(&modelTable, &m->en);
-			deleteModel(m);
-			delete m;
-		}
+	unsigned int it = 0;
+	struct HashMapSlot *slot;
+	while ((slot = hashMapNext(&modelTable, &it))) {
+		struct Model *m = (struct Model *)slot->value;
+		deleteModel(m);
+		delete m;
 	}
+	unsigned int size = modelTable.capacity;
+	hashMapDestroy(&modelTable);
+	hashMapCreate(&modelTable, size - size / 4);
 }
 
 struct Model *getModel(const char *name) {
-	struct Model *ret = (struct Model *)HTGet(&modelTable, name);
+	struct Model *ret = (struct Model *)hashMapGet(&modelTable, name);
 	if (!ret) {
 		logNorm("Model %s does not exist\n", name);
 	}
@@ -604,7 +616,7 @@ extern "C" {
 
 void drawInit(void) {
 	drawDriverInit();
-	HTCreate(&modelTable, 128);
+	hashMapCreate(&modelTable, 128);
 
 	rttW = rttIntW = winW = realWinW;
 	rttH = rttIntH = winH = realWinH;
@@ -621,7 +633,7 @@ void drawFini(void) {
 	ttfFini();
 	drawVmFini();
 	anim3DFini();
-	HTDestroy(&modelTable);
+	hashMapDestroy(&modelTable);
 	drawDriverFini();
 }
 
@@ -1,3 +1,4 @@
+#define MEM_TAG MEM_TAG_DRAW
 #include <gfx/drawvm.h>
 #include <gfx/ttf.h>
 #include <events.h>
@@ -14,6 +15,10 @@ float drawVmGlobalsF[8];
 
 static struct DrawVm *curDvm;
 
+/* Deletes during drawVmUpdateAll are deferred so no component moves while the list is walked */
+static struct EcsCmdBuffer dvmCmds;
+static bool dvmUpdating;
+
 struct DrawVmLayer {
 	struct DrawVm *first;
 	struct DrawVm *last;
@@ -22,16 +27,14 @@ static struct DrawVmLayer layers[DVM_N_LAYERS];
 
 static struct IchigoState iState;
 
-#define TEX_KEY_SZ 64
 struct DrawVmTextureList {
-	char key[TEX_KEY_SZ];
+	strid_t key;
 	struct Texture *tex;
 };
 static struct Vector texList;
 
-#define POSE_KEY_SZ 64
 struct DrawVmPoseFileList {
-	char key[POSE_KEY_SZ];
+	strid_t key;
 	struct LoadedPoseFile *lpf;
 };
 static struct Vector poseList;
@@ -129,18 +132,20 @@ static struct DrawVm *drawVmDrawTransform(struct DrawVm *d, struct DrawVm *paren
 				drawVmDrawTransform(p2, NULL);
 			}
 		} else {
-			struct Transform *tf = getComponentOpt(TRANSFORM, d->entity);
-			if (tf) {
+			struct Transform *cur = getComponentOpt(TRANSFORM, d->entity);
+			if (cur) {
+				struct Transform tf;
+				tfInterpolated(&tf, cur);
 				if (d->flags & DVM_FLAG_TF_3D_ROTATION) {
-					drawTransform3D(tf);
+					drawTransform3D(&tf);
 				} else {
 					if (d->flags & DVM_FLAG_ROUNDED_POS) {
-						drawTransformRounded(tf);
+						drawTransformRounded(&tf);
 					} else {
-						drawTransform(tf);
+						drawTransform(&tf);
 					}
 					if (d->flags & DVM_FLAG_TF_ROTATION) {
-						drawTransformRotation(tf);
+						drawTransformRotation(&tf);
 					}
 				}
 			} else {
@@ -308,7 +313,16 @@ static void drawVmDrawLayer(void *arg) {
 
 static void dvmDelete(struct DrawVm *d) {
 	entity_t en = d->entity;
-	if (d->flags & DVM_FLAG_DELETE_ALL) {
+	if (dvmUpdating) {
+		d->state = DVM_DELETED;
+		if (d->flags & DVM_FLAG_DELETE_ALL) {
+			ecsCmdDeleteEntity(&dvmCmds, en);
+		} else {
+			ecsCmdRemoveComponent(&dvmCmds, DRAW_VM, en);
+			ecsCmdRemoveComponent(&dvmCmds, DRAW_VM_VM, en);
+			ecsCmdRemoveComponent(&dvmCmds, DRAW_VM_LOCALS, en);
+		}
+	} else if (d->flags & DVM_FLAG_DELETE_ALL) {
 		deleteEntity(en);
 	} else {
 		removeComponent(DRAW_VM, en);
@@ -325,7 +339,7 @@ static float addNormalized(float x, float add, float scale) {
 		v -= 2 * scale;
 	return v;
 }
-static bool drawVmUpdate(struct DrawVm *d) {
+static void drawVmUpdate(struct DrawVm *d) {
 	/* Update VM */
 	if (d->state == DVM_RUNNING) {
 		struct IchigoVm *vm = getComponent(DRAW_VM_VM, d->entity);
@@ -350,9 +364,9 @@ static bool drawVmUpdate(struct DrawVm *d) {
 	}
 	if (d->state == DVM_DELETED) {
 		dvmDelete(d);
-		return false;
+		return;
 	} else if (d->state == DVM_STATIC) {
-		return true;
+		return;
 	}
 
 	d->xScale += d->xGrow;
@@ -376,7 +390,6 @@ static bool drawVmUpdate(struct DrawVm *d) {
 		d->tex[i].x = addNormalized(d->tex[i].x, d->texScroll[i].x, 1);
 		d->tex[i].y = addNormalized(d->tex[i].y, d->texScroll[i].y, 1);
 	}
-	return true;
 }
 static void drawVmAddToLayerList(struct DrawVm *d, struct DrawVm *parent) {
 	if (!parent || parent->layer != d->layer) {
@@ -394,31 +407,44 @@ static void drawVmAddToLayerList(struct DrawVm *d, struct DrawVm *parent) {
 
 static void drawVmUpdateAll(void *arg) {
 	(void)arg;
-	/* Clear linked lists */
-	for (int i = 0; i < DVM_N_LAYERS; i++) {
-		layers[i].first = NULL;
-		layers[i].last = NULL;
-	}
-
-	drawVmCount = 0;
+	dvmUpdating = true;
 	for (struct DrawVm *d = clBegin(DRAW_VM); d; d = clNext(DRAW_VM, d)) {
-		struct DrawVm *parent = NULL;
 		if (d->parent) {
-			parent = getComponentOpt(DRAW_VM, d->parent);
-			if (!parent) {
+			struct DrawVm *parent = getComponentOpt(DRAW_VM, d->parent);
+			if (!parent || parent->state == DVM_DELETED) {
 				/* Parent deleted, delete this too */
 				dvmDelete(d);
 				continue;
 			}
 		}
-		bool draw = true;
 		if (!d->layer || d->layer >= drawVmUpdateSkip)
-			draw = drawVmUpdate(d);
+			drawVmUpdate(d);
+	}
+	dvmUpdating = false;
+	ecsCmdFlush(&dvmCmds);
 
-		if (draw) {
-			drawVmAddToLayerList(d, parent);
-			drawVmCount++;
+	/*
+	 * The VM lists follow the DRAW_VM order for the next update. DRAW_VM itself is not sorted by layer,
+	 * its order is the order scripts run in and parents have to update before their children.
+	 */
+	componentListGroup(DRAW_VM_VM, DRAW_VM);
+	componentListGroup(DRAW_VM_LOCALS, DRAW_VM);
+
+	/* Build the layer lists only now, the flush may have moved components */
+	for (int i = 0; i < DVM_N_LAYERS; i++) {
+		layers[i].first = NULL;
+		layers[i].last = NULL;
+	}
+	drawVmCount = 0;
+	for (struct DrawVm *d = clBegin(DRAW_VM); d; d = clNext(DRAW_VM, d)) {
+		struct DrawVm *parent = NULL;
+		if (d->parent) {
+			parent = getComponentOpt(DRAW_VM, d->parent);
+			if (!parent)
+				continue; /* Deleted next update */
 		}
+		drawVmAddToLayerList(d, parent);
+		drawVmCount++;
 	}
 }
 
@@ -509,9 +535,10 @@ void drawVmTexture(struct DrawVm *d, int slot, const char *texture) {
 		d->tex[slot].tex = drawGetFboTexture(texture[1] - '0');
 		return;
 	}
+	strid_t key = strIntern(texture);
 	for (unsigned int i = 0; i < vecCount(&texList); i++) {
 		struct DrawVmTextureList *t = vecAt(&texList, i);
-		if (!strcmp(texture, t->key)) {
+		if (t->key == key) {
 			tl = t;
 			break;
 		}
@@ -524,8 +551,7 @@ void drawVmTexture(struct DrawVm *d, int slot, const char *texture) {
 		struct Texture *tex = srgb ? loadTexture3D(texture) : loadTexture(texture);
 		if (tex) {
 			tl = vecInsert(&texList, -1);
-			strncpy(tl->key, texture, TEX_KEY_SZ - 1);
-			tl->key[TEX_KEY_SZ - 1] = 0;
+			tl->key = key;
 			tl->tex = tex;
 			d->tex[slot].tex = tex;
 		}
@@ -534,9 +560,10 @@ void drawVmTexture(struct DrawVm *d, int slot, const char *texture) {
 
 void drawVmPoseFile(struct DrawVm *d, const char *poseFile) {
 	struct DrawVmPoseFileList *pl = NULL;
+	strid_t key = strIntern(poseFile);
 	for (unsigned int i = 0; i < vecCount(&poseList); i++) {
 		struct DrawVmPoseFileList *p = vecAt(&poseList, i);
-		if (!strcmp(poseFile, p->key)) {
+		if (p->key == key) {
 			pl = p;
 			break;
 		}
@@ -549,8 +576,7 @@ void drawVmPoseFile(struct DrawVm *d, const char *poseFile) {
 		struct LoadedPoseFile *lpf = loadPoseFile(poseFile);
 		if (lpf) {
 			pl = vecInsert(&poseList, -1);
-			strncpy(pl->key, poseFile, POSE_KEY_SZ - 1);
-			pl->key[POSE_KEY_SZ - 1] = 0;
+			pl->key = key;
 			pl->lpf = lpf;
 			as->poseFile = pl->lpf;
 		}
@@ -624,6 +650,22 @@ static void drawVmNotifier(void *arg, void *component, int type) {
 				deleteEntity(c->entity);
 			}
 		}*/
+	} else if (type == NOTIFY_SNAPSHOT || type == NOTIFY_RESTORE) {
+		/* The copy holds its own reference to TTF textures and custom shaders */
+		if (d->flags & DVM_FLAG_TTF && d->tex[0].tex)
+			d->tex[0].tex->refs++;
+		drawShaderRef(d->customShader);
+		if (type == NOTIFY_RESTORE) {
+			/* Rebuilt by the next update */
+			for (int i = 0; i < DVM_N_LAYERS; i++) {
+				layers[i].first = NULL;
+				layers[i].last = NULL;
+			}
+		}
+	} else if (type == NOTIFY_SNAPSHOT_FREE) {
+		if (d->flags & DVM_FLAG_TTF)
+			deleteTexture(d->tex[0].tex);
+		drawShaderDelete(d->customShader);
 	} else if (type == NOTIFY_PURGE) {
 		for (d = clBegin(DRAW_VM); d; d = clNext(DRAW_VM, d)) {
 			if (d->customShader) {
@@ -643,6 +685,10 @@ static void drawVmVmNotifier(void *arg, void *component, int type) {
 		ichigoVmNew(&iState, vm, vm->en);
 	} else if (type == NOTIFY_DELETE) {
 		ichigoVmDelete(vm);
+	} else if (type == NOTIFY_SNAPSHOT || type == NOTIFY_RESTORE) {
+		ichigoVmCloneStacks(vm);
+	} else if (type == NOTIFY_SNAPSHOT_FREE) {
+		ichigoVmFreeStacks(vm);
 	} else if (type == NOTIFY_PURGE) {
 		for (vm = clBegin(DRAW_VM_VM); vm; vm = clNext(DRAW_VM_VM, vm)) {
 			ichigoVmDelete(vm);
@@ -814,12 +860,14 @@ static void i_wvel(struct IchigoVm *vm) {
 }
 static void i_shader(struct IchigoVm *vm) {
 	struct DrawVm *d = GET_DVM(vm);
+	drawShaderDelete(d->customShader);
 	d->customShader = NULL;
 	d->stdShader = ichigoGetInt(vm, 0);
 }
 static void i_shaderCustom(struct IchigoVm *vm) {
 	struct DrawVm *d = GET_DVM(vm);
 	uint16_t strLen;
+	drawShaderDelete(d->customShader);
 	d->customShader = drawShaderNew(ichigoGetString(&strLen, vm, 0), ichigoGetString(&strLen, vm, 1));
 }
 static void i_color(struct IchigoVm *vm) {
@@ -1009,7 +1057,7 @@ static void i_animSet(struct IchigoVm *vm) {
 	struct Anim3DState *as = getComponentOpt(ANIM_STATE, vm->en);
 	if (as) {
 		uint16_t nameLen;
-		as->animName = ichigoGetString(&nameLen, vm, 0);
+		as->animName = strIntern(ichigoGetString(&nameLen, vm, 0));
 	}
 }
 static void i_animTime(struct IchigoVm *vm) {
@@ -1188,10 +1236,12 @@ void drawVmInit(void) {
 
 	vecCreate(&texList, sizeof(struct DrawVmTextureList));
 	vecCreate(&poseList, sizeof(struct DrawVmPoseFileList));
+	ecsCmdCreate(&dvmCmds);
 }
 
 void drawVmFini(void) {
 	drawVmEndScene();
+	ecsCmdDestroy(&dvmCmds);
 	vecDestroy(&poseList);
 	vecDestroy(&texList);
 	removeUpdate(UPDATE_UI, drawVmUpdateAll);
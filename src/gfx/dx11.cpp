@@ -5,6 +5,7 @@
 #include <assets.h>
 #include <string.h>
 #include <events.h>
+#include <prof.h>
 #include "gfx.h"
 
 #define WIN32_LEAN_AND_MEAN
@@ -161,6 +162,7 @@ extern "C" {
 struct Shader {
 	VertexShader vertex;
 	ID3D11PixelShader *pixel;
+	int refs;
 };
 
 struct Shader *drawShaderNew(const char *vert, const char *frag) {
@@ -233,12 +235,20 @@ struct Shader *drawShaderNew(const char *vert, const char *frag) {
 	shader = new Shader;
 	shader->vertex = vertexShader;
 	shader->pixel = pixelShader;
+	shader->refs = 1;
 
 	return shader;
 }
 
+struct Shader *drawShaderRef(struct Shader *s) {
+	if (s)
+		s->refs++;
+	return s;
+}
+
 void drawShaderDelete(struct Shader *s) {
-	delete s;
+	if (s && --s->refs <= 0)
+		delete s;
 }
 
 void drawShaderUse(struct Shader *s) {
@@ -678,6 +688,7 @@ static void drawSetConstants(Mat *model) {
 	}
 }
 void drawFlush(void) {
+	PROF_SCOPE("drawFlush");
 	if (drawState.hasBuffer) {
 		deviceContext->Unmap(streamVertexBuffer, 0);
 		streamVertexMappedBuffer.pData = nullptr;
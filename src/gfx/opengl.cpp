@@ -1,7 +1,9 @@
+#define MEM_TAG MEM_TAG_DRAW
 #include <gfx/draw.h>
 #include <gfx/opengl.h>
 #include <mem.h>
 #include <events.h>
+#include <prof.h>
 #include <stdio.h>
 #include <string.h>
 #include <vec.h>
@@ -182,14 +184,21 @@ struct Shader *drawShaderNew(const char *vert, const char *frag) {
 	unsigned int f = loadShader(frag, GL_FRAGMENT_SHADER);
 
 	s->glShader = linkShaders(v, f);
+	s->refs = 1;
 
 	glDeleteShader(v);
 	glDeleteShader(f);
 	return s;
 }
 
+struct Shader *drawShaderRef(struct Shader *s) {
+	if (s)
+		s->refs++;
+	return s;
+}
+
 void drawShaderDelete(struct Shader *s) {
-	if (s) {
+	if (s && --s->refs <= 0) {
 		glDeleteShader(s->glShader);
 		delete s;
 	}
@@ -545,8 +554,9 @@ static void setLightUniform(struct StdUniformFragLight *fl, struct Light *l, boo
 	fl->quadratic = l->quadratic;
 }
 static void setStdUniforms(const Mat *model) {
-	StdUniformVert *v = static_cast<StdUniformVert *>(stackAlloc(sizeof(*v)));
-	StdUniformFrag *f = static_cast<StdUniformFrag *>(stackAlloc(sizeof(*f)));
+	size_t mark = frameMark();
+	StdUniformVert *v = static_cast<StdUniformVert *>(frameAlloc(sizeof(*v)));
+	StdUniformFrag *f = static_cast<StdUniformFrag *>(frameAlloc(sizeof(*f)));
 
 	memcpy(v->model, model->m, sizeof(v->model));
 	if (drawState.drawPhase <= DP_3D_NO_CULL && drawState.drawPhase != DP_3D_BG) {
@@ -591,7 +601,7 @@ static void setStdUniforms(const Mat *model) {
 	glBufferData(GL_UNIFORM_BUFFER, sizeof(*f), f, GL_STREAM_DRAW);
 	glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-	stackDealloc(sizeof(*f) + sizeof(*v));
+	frameRewind(mark);
 
 	unsigned int vIdx = glGetUniformBlockIndex(drawState.shader->glShader, "stdVert");
 	glUniformBlockBinding(drawState.shader->glShader, vIdx, 0);
@@ -625,6 +635,7 @@ void drawSetAnimUbo(void *data, size_t dataSize) {
 }
 
 void drawFlush(void) {
+	PROF_SCOPE("drawFlush");
 	if (curVboData) {
 		glUnmapBuffer(GL_ARRAY_BUFFER);
 		curVboData = NULL;
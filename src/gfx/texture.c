@@ -1,3 +1,4 @@
+#define MEM_TAG MEM_TAG_DRAW
 #include <main.h>
 #include <gfx/texture.h>
 #include <mem.h>
@@ -30,7 +31,7 @@ static unsigned char *lTex(size_t *bufSz, struct TextureFileHeader *header, stru
 
 	/* Load the image data */
 	size_t size = header->w * header->h * 4; /* 32 bpp */
-	unsigned char *buf = globalAlloc(size);
+	unsigned char *buf = globalAllocUninit(size);
 	rd = assetRead(a, buf, size);
 	if (rd != size) {
 		logNorm(unexpectedEOFMsg, fileName);
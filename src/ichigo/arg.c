@@ -1,3 +1,4 @@
+#define MEM_TAG MEM_TAG_ICHIGO
 #include "ich.h"
 
 struct IchigoVar *ichGetExternVar(struct IchigoState *state, int reg) {
@@ -20,15 +21,7 @@ struct IchigoReg *ichGetReg(struct IchigoState *state, struct IchigoCallFrame *c
 	if (reg >= cf->nRegs) {
 		cf->nRegs = reg + 1;
 		if (r >= co->regs.nElements) {
-			if (r >= co->regs.nAllocations) {
-				/* Allocate new regs */
-				int st = co->regs.nAllocations;
-				co->regs.nAllocations = r + 4;
-				co->regs.data = ichRealloc(co->regs.data, co->regs.nAllocations * co->regs.elementSize);
-				for (int i = st; i < co->regs.nAllocations; i++) {
-					memset(ichVecAt(&co->regs, i), 0, sizeof(struct IchigoReg));
-				}
-			}
+			ichVecReserve(&co->regs, r + 1);
 			co->regs.nElements = r + 1;
 			memset(ichVecAt(&co->regs, r), 0, sizeof(struct IchigoReg));
 		}
@@ -687,6 +680,7 @@ static struct IchigoHeapObject *ichigoSetArrayMutReg(struct IchigoReg *reg, cons
 	if (regType == REG_BYTE)
 		dataSz += 1;
 	ho->data = globalAlloc(dataSz);
+	ho->size = (uint32_t)dataSz;
 	if (data) {
 		memcpy(ho->data, data, dataSz);
 	}
@@ -39,8 +39,16 @@ static inline void ichHeapDelete(ENTITY en) {
 	deleteEntity(en);
 }
 
+#define ICH_VEC_MIN_ALLOC 4
+/* Initial capacity of coroutine stacks */
+#define ICH_INIT_CALL_FRAMES 8
+#define ICH_INIT_REGS 32
+
 void ichVecCreate(struct IchigoVector *vec, unsigned int elementSize);
+void ichVecCreateCap(struct IchigoVector *vec, unsigned int elementSize, unsigned int capacity);
+void ichVecReserve(struct IchigoVector *vec, unsigned int n); /* Make room for n elements, new memory is cleared */
 void ichVecDestroy(struct IchigoVector *vec);
+void ichVecClone(struct IchigoVector *vec); /* Give a bytewise copy of a vector its own data */
 void *ichVecAppend(struct IchigoVector *vec);
 void ichVecDelete(struct IchigoVector *vec, unsigned int index);
 
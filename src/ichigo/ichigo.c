@@ -51,6 +51,12 @@ int ichigoAddFile(struct IchigoState *state, const char *file) {
 		if (!memcmp(chk->sig, "FN\0", 4)) {
 			struct IchigoFn **fn = ichVecAppend(&state->fns);
 			*fn = (struct IchigoFn *)(chk + 1);
+			/* The first function loaded under a name wins */
+			const char *name = strName(strInternLen((const char *)(*fn + 1) + (*fn)->paramCount, (*fn)->nameLen));
+			uint32_t hash = hashString(name);
+			if (!hashMapGetHashed(&state->fnMap, name, hash)) {
+				hashMapPutHashed(&state->fnMap, name, hash, *fn);
+			}
 		} else if (!memcmp(chk->sig, "IMPT", 4)) {
 			struct IchigoImport *imp = (struct IchigoImport *)(chk + 1);
 			char nameBuf[128];
@@ -81,6 +87,7 @@ void ichigoClear(struct IchigoState *state) {
 	}
 	ichVecDestroy(&state->files);
 	ichVecDestroy(&state->fns);
+	hashMapDestroy(&state->fnMap);
 	ichVecDestroy(&state->globals);
 }
 
@@ -88,6 +95,7 @@ void ichigoInit(struct IchigoState *newState, const char *baseDir) {
 	struct IchigoState *s = newState;
 	ichVecCreate(&s->files, sizeof(struct IchigoLoadedFile));
 	ichVecCreate(&s->fns, sizeof(struct IchigoFn *));
+	hashMapCreate(&s->fnMap, 64);
 	ichVecCreate(&s->globals, sizeof(struct IchigoGlobal *));
 
 	s->baseDir = baseDir;
@@ -117,6 +125,11 @@ void ichVecCreate(struct IchigoVector *vec, unsigned int elementSize) {
 	vec->data = NULL;
 }
 
+void ichVecCreateCap(struct IchigoVector *vec, unsigned int elementSize, unsigned int capacity) {
+	ichVecCreate(vec, elementSize);
+	ichVecReserve(vec, capacity);
+}
+
 void ichVecDestroy(struct IchigoVector *vec) {
 	vec->nElements = 0;
 	vec->nAllocations = 0;
@@ -125,13 +138,33 @@ void ichVecDestroy(struct IchigoVector *vec) {
 	vec->data = NULL;
 }
 
+void ichVecClone(struct IchigoVector *vec) {
+	if (vec->data) {
+		size_t sz = vec->nAllocations * vec->elementSize;
+		char *data = ichAlloc(sz);
+		memcpy(data, vec->data, sz);
+		vec->data = data;
+	}
+}
+
+void ichVecReserve(struct IchigoVector *vec, unsigned int n) {
+	if (n <= vec->nAllocations)
+		return;
+	assert(n <= UINT16_MAX);
+	/* Double the size so deep call stacks only reallocate a logarithmic number of times */
+	unsigned int newAllocations = (vec->nAllocations == 0) ? ICH_VEC_MIN_ALLOC : vec->nAllocations * 2;
+	if (newAllocations < n)
+		newAllocations = n;
+	if (newAllocations > UINT16_MAX)
+		newAllocations = UINT16_MAX;
+	vec->data = ichRealloc(vec->data, newAllocations * vec->elementSize);
+	memset((char *)vec->data + vec->nAllocations * vec->elementSize, 0, (newAllocations - vec->nAllocations) * vec->elementSize);
+	vec->nAllocations = newAllocations;
+}
+
 void *ichVecAppend(struct IchigoVector *vec) {
 	if (vec->nElements == vec->nAllocations) {
-		/* Allocate new */
-		unsigned int newAllocations = (vec->nAllocations == 0) ? 4 : vec->nAllocations + 4;
-		vec->data = ichRealloc(vec->data, newAllocations * vec->elementSize);
-		memset((char *)vec->data + vec->nAllocations * vec->elementSize, 0, (newAllocations - vec->nAllocations) * vec->elementSize);
-		vec->nAllocations = newAllocations;
+		ichVecReserve(vec, vec->nElements + 1);
 	}
 	int pos = vec->nElements;
 	vec->nElements += 1;
@@ -146,11 +179,17 @@ void ichVecDelete(struct IchigoVector *vec, unsigned int index) {
 
 static void ichHeapNotifier(void *arg, void *component, int type) {
 	(void)arg;
-	if (type == NOTIFY_DELETE) {
-		struct IchigoHeapObject *ho = component;
+	struct IchigoHeapObject *ho = component;
+	if (type == NOTIFY_DELETE || type == NOTIFY_SNAPSHOT_FREE) {
 		ichFree(ho->data);
+	} else if (type == NOTIFY_SNAPSHOT || type == NOTIFY_RESTORE) {
+		if (ho->data) {
+			void *data = ichAlloc(ho->size);
+			memcpy(data, ho->data, ho->size);
+			ho->data = data;
+		}
 	} else if (type == NOTIFY_PURGE) {
-		for (struct IchigoHeapObject *ho = clBegin(ICHIGO_HEAP_OBJ); ho; ho = clNext(ICHIGO_HEAP_OBJ, ho)) {
+		for (ho = clBegin(ICHIGO_HEAP_OBJ); ho; ho = clNext(ICHIGO_HEAP_OBJ, ho)) {
 			ichFree(ho->data);
 		}
 	}
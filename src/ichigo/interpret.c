@@ -1,3 +1,4 @@
+#define MEM_TAG MEM_TAG_ICHIGO
 #include "ich.h"
 
 static void ichDecodeInstr(struct IchigoState *is, struct IchigoCorout *co) {
@@ -95,8 +96,8 @@ static int ichInstrCall(struct IchigoVm *vm, struct IchigoCorout *co, bool async
 		destCo->active = true;
 		destCo->waitTime = 0;
 		destCo->pc = NULL;
-		ichVecCreate(&destCo->callFrames, sizeof(struct IchigoCallFrame));
-		ichVecCreate(&destCo->regs, sizeof(struct IchigoReg));
+		ichVecCreateCap(&destCo->callFrames, sizeof(struct IchigoCallFrame), ICH_INIT_CALL_FRAMES);
+		ichVecCreateCap(&destCo->regs, sizeof(struct IchigoReg), ICH_INIT_REGS);
 	} else {
 		destCo = co;
 	}
@@ -349,6 +350,7 @@ static void ichStdInstr(bool *killed, struct IchigoVm *vm, struct IchigoCorout *
 			if (ho->len < idx) {
 				ho->len = idx;
 				ho->data = globalRealloc(ho->data, idx * 4);
+				ho->size = idx * 4;
 			}
 			((int *)ho->data)[idx] = ichigoGetInt(vm, 2);
 		}
@@ -362,6 +364,7 @@ static void ichStdInstr(bool *killed, struct IchigoVm *vm, struct IchigoCorout *
 			if (ho->len < idx) {
 				ho->len = idx;
 				ho->data = globalRealloc(ho->data, idx * 4);
+				ho->size = idx * 4;
 			}
 			((float *)ho->data)[idx] = ichigoGetFloat(vm, 2);
 		}
@@ -375,6 +378,7 @@ static void ichStdInstr(bool *killed, struct IchigoVm *vm, struct IchigoCorout *
 			if (ho->len < idx) {
 				ho->len = idx;
 				ho->data = globalRealloc(ho->data, idx * sizeof(ENTITY));
+				ho->size = idx * sizeof(ENTITY);
 			}
 			((ENTITY *)ho->data)[idx] = ichigoGetEntity(vm, 2);
 		}
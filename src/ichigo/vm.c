@@ -14,17 +14,28 @@ void ichigoVmDelete(struct IchigoVm *vm) {
 	ichigoVmKillAll(vm);
 }
 
-struct IchigoFn *ichFindFn(struct IchigoState *state, const char *name) {
-	int nameLen = (int)strlen(name);
-	for (int i = 0; i < state->fns.nElements; i++) {
-		struct IchigoFn **fnp = ichVecAt(&state->fns, i);
-		struct IchigoFn *fn = *fnp;
-		const char *fnName = (const char *)(fn + 1) + fn->paramCount;
-		if (nameLen == fn->nameLen && !memcmp(fnName, name, nameLen)) {
-			return fn;
+void ichigoVmCloneStacks(struct IchigoVm *vm) {
+	for (int i = 0; i < ICHIGO_VM_MAX_COROUT; i++) {
+		struct IchigoCorout *c = &vm->coroutines[i];
+		if (c->active) {
+			ichVecClone(&c->regs);
+			ichVecClone(&c->callFrames);
+		}
+	}
+}
+
+void ichigoVmFreeStacks(struct IchigoVm *vm) {
+	for (int i = 0; i < ICHIGO_VM_MAX_COROUT; i++) {
+		struct IchigoCorout *c = &vm->coroutines[i];
+		if (c->active) {
+			ichVecDestroy(&c->regs);
+			ichVecDestroy(&c->callFrames);
 		}
 	}
-	return NULL;
+}
+
+struct IchigoFn *ichFindFn(struct IchigoState *state, const char *name) {
+	return hashMapGet(&state->fnMap, name);
 }
 
 static void ichPushFnArg(struct IchigoCorout *co, struct IchigoReg *reg) {
@@ -84,8 +95,8 @@ int ichigoVmExec(struct IchigoVm *vm, const char *fn, const char *params, ...) {
 		return -1;
 	}
 
-	ichVecCreate(&c->callFrames, sizeof(struct IchigoCallFrame));
-	ichVecCreate(&c->regs, sizeof(struct IchigoReg));
+	ichVecCreateCap(&c->callFrames, sizeof(struct IchigoCallFrame), ICH_INIT_CALL_FRAMES);
+	ichVecCreateCap(&c->regs, sizeof(struct IchigoReg), ICH_INIT_REGS);
 
 	struct IchigoFn *icf;
 	int err = ichPushFn(&icf, vm->is, c, fn);
@@ -4,6 +4,7 @@
 #include <SDL2/SDL.h>
 #include <assets.h>
 #include <gfx/draw.h>
+#include <prof.h>
 
 bool gamepadConnected;
 
@@ -96,6 +97,24 @@ bool inputHandleEvent(struct Event *ev, void *sdlEvent) {
 	if (ev->type == EVENT_KEY && !ev->param2 && ev->param == SDLK_BACKSPACE) {
 		switchScene(sceneName);
 	}
+	if (ev->type == EVENT_KEY && !ev->param2 && ev->param == SDLK_F9) {
+		memDumpTags();
+	}
+	if (ev->type == EVENT_KEY && !ev->param2 && ev->param == SDLK_F10) {
+		pacerDumpStats();
+		frameStatsDump();
+	}
+	if (ev->type == EVENT_KEY && !ev->param2 && ev->param == SDLK_F11) {
+		eventDumpSchedule();
+	}
+#endif
+#ifdef PROF_ENABLED
+	if (ev->type == EVENT_KEY && !ev->param2 && ev->param == SDLK_F12) {
+		if (profRecording)
+			profStop("profile.json");
+		else
+			profStart();
+	}
 #endif
 	return true;
 }
@@ -0,0 +1,121 @@
+#include <main.h>
+#include <jobs.h>
+#include <ecs.h>
+#include <assets.h>
+#include <mem.h>
+#include <SDL2/SDL.h>
+#include <stdint.h>
+
+#include "system_init.h"
+
+static SDL_Thread *workers[JOBS_MAX_THREADS];
+static int nThreads = 1;
+static bool jobsQuit;
+
+/* Each woken worker waits on startSem once and posts doneSem once */
+static SDL_sem *startSem;
+static SDL_sem *doneSem;
+
+static void (*jobFn)(void *arg, unsigned int i);
+static void *jobArg;
+static unsigned int jobCount;
+static SDL_atomic_t jobNext;
+
+static THREAD_LOCAL int threadIndex;
+static THREAD_LOCAL bool inJob;
+
+static void runJob(void) {
+	inJob = true;
+	for (;;) {
+		unsigned int i = (unsigned int)SDL_AtomicAdd(&jobNext, 1);
+		if (i >= jobCount)
+			break;
+		jobFn(jobArg, i);
+	}
+	inJob = false;
+}
+
+static int workerMain(void *arg) {
+	threadIndex = (int)(intptr_t)arg;
+	for (;;) {
+		SDL_SemWait(startSem);
+		if (jobsQuit)
+			break;
+		runJob();
+		SDL_SemPost(doneSem);
+	}
+	memThreadFini();
+	return 0;
+}
+
+int jobsThreadCount(void) {
+	return nThreads;
+}
+
+int jobsThreadIndex(void) {
+	return threadIndex;
+}
+
+void jobsParallelFor(unsigned int n, void (*fn)(void *arg, unsigned int i), void *arg) {
+	if (nThreads == 1 || n < 2 || inJob) {
+		for (unsigned int i = 0; i < n; i++) {
+			fn(arg, i);
+		}
+		return;
+	}
+
+	jobFn = fn;
+	jobArg = arg;
+	jobCount = n;
+	SDL_AtomicSet(&jobNext, 0);
+
+	unsigned int nWake = n - 1 < (unsigned int)nThreads - 1 ? n - 1 : (unsigned int)nThreads - 1;
+	for (unsigned int i = 0; i < nWake; i++) {
+		SDL_SemPost(startSem);
+	}
+	runJob();
+	for (unsigned int i = 0; i < nWake; i++) {
+		SDL_SemWait(doneSem);
+	}
+}
+
+void jobsInit(void) {
+	/* Leave a core for the rest of the system */
+	nThreads = SDL_GetCPUCount() - 1;
+	if (nThreads < 1)
+		nThreads = 1;
+	if (nThreads > JOBS_MAX_THREADS)
+		nThreads = JOBS_MAX_THREADS;
+
+	jobsQuit = false;
+	startSem = SDL_CreateSemaphore(0);
+	doneSem = SDL_CreateSemaphore(0);
+	for (int i = 1; i < nThreads; i++) {
+		workers[i] = SDL_CreateThread(workerMain, "Worker", (void *)(intptr_t)i);
+		if (!workers[i]) {
+			fail("Failed to create worker thread: %s\n", SDL_GetError());
+		}
+	}
+
+	ecsSetParallelFor(jobsParallelFor);
+	ecsSetThreadIndex(jobsThreadIndex);
+	logDebug("Job system started with %d threads\n", nThreads);
+}
+
+void jobsFini(void) {
+	ecsSetParallelFor(NULL);
+	ecsSetThreadIndex(NULL);
+
+	jobsQuit = true;
+	for (int i = 1; i < nThreads; i++) {
+		SDL_SemPost(startSem);
+	}
+	for (int i = 1; i < nThreads; i++) {
+		SDL_WaitThread(workers[i], NULL);
+		workers[i] = NULL;
+	}
+	nThreads = 1;
+
+	SDL_DestroySemaphore(startSem);
+	SDL_DestroySemaphore(doneSem);
+}
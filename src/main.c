@@ -31,7 +31,9 @@ int runEngine(void) {
 		fail("SDL_Init failed\n");
 
 	memInit();
+	profInit();
 	ecsInit();
+	jobsInit();
 
 	/* Get game folders */
 	gameDir = SDL_GetBasePath();
@@ -77,6 +79,9 @@ int runEngine(void) {
 	inputFini();
 	eventFini();
 
+	jobsFini();
+	profFini();
+
 	assetArchive(0, NULL);
 	assetFini();
 
@@ -1,25 +1,80 @@
+#ifndef _WIN32
+#define _DEFAULT_SOURCE /* For MAP_ANONYMOUS */
+#endif
 #include <mem.h>
 #include <assets.h>
 
 #include <string.h>
 #include <stdlib.h>
+#include <immintrin.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 #define BIG_STACK_SIZE	0x4000000 //64MB
+#define WORKER_STACK_SIZE	0x400000 //4MB
+#define FRAME_ARENA_SIZE	0x4000000 //64MB
+#define FRAME_ARENA_ALIGN	16
+#define FRAME_POISON	0xDD
+
+/* Poison rewound frame arena memory and log new high-water marks */
+#ifndef RELEASE
+#define MEM_DEBUG
+#endif
+
+/* Every thread has its own bigstack, the main thread's is made by memInit and the others on first use */
+static THREAD_LOCAL char *bigStackStart;
+static THREAD_LOCAL size_t bigStackPtr;
+
+/* Per tag counters, updated atomically since any thread may allocate */
+static volatile long long tagLive[MEM_TAG_COUNT];
+static volatile long long tagPeak[MEM_TAG_COUNT];
+static volatile long tagFrameAllocs[MEM_TAG_COUNT];
+static struct MemTagStats tagLastFrame[MEM_TAG_COUNT];
+
+static const char *tagNames[MEM_TAG_COUNT] = {
+	"general", "ecs", "asset", "ichigo", "draw", "physics", "audio"
+};
 
-static char *bigStackStart;
-static size_t bigStackPtr;
+#ifdef _MSC_VER
+#define atomicAdd64(p, v) (_InterlockedExchangeAdd64((p), (v)) + (v))
+#define atomicInc(p) _InterlockedIncrement(p)
+#else
+#define atomicAdd64(p, v) __atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+#define atomicInc(p) __atomic_add_fetch((p), 1, __ATOMIC_RELAXED)
+#endif
+
+static void tagAdd(unsigned int tag, long long bytes) {
+	long long live = atomicAdd64(&tagLive[tag], bytes);
+	if (live > tagPeak[tag])
+		tagPeak[tag] = live; /* A racing update may lose a peak, which is fine for statistics */
+}
+
+static char *frameArenaStart;
+static size_t frameArenaPtr;
+static size_t frameArenaHigh;
+#ifdef MEM_DEBUG
+static size_t frameArenaReported;
+#endif
 
 
 void memInit(void) {
 	bigStackStart = globalAlloc(BIG_STACK_SIZE);
 	bigStackPtr = BIG_STACK_SIZE;
+	frameArenaStart = globalAlloc(FRAME_ARENA_SIZE);
+	frameArenaPtr = 0;
 }
 
 /*
  * BigStack
  */
 
-void *stackAlloc(size_t sz) {
+void *stackAllocTag(size_t sz, int tag) {
+	atomicInc(&tagFrameAllocs[tag]);
+	if (!bigStackStart) {
+		bigStackStart = globalAlloc(WORKER_STACK_SIZE);
+		bigStackPtr = WORKER_STACK_SIZE;
+	}
 	if (sz > bigStackPtr) {
 		fail("Out of bigstack memory!\n");
 	}
@@ -31,30 +86,295 @@ void stackDealloc(size_t sz) {
 	bigStackPtr += sz;
 }
 
+static void cacheThreadFlush(void);
+void memThreadFini(void) {
+	cacheThreadFlush();
+	if (bigStackStart)
+		globalDealloc(bigStackStart);
+	bigStackStart = NULL;
+	bigStackPtr = 0;
+}
+
 /*
- * Global alloc
+ * Frame arena
  */
 
-void *globalAlloc(size_t sz) {
-	void *ret = calloc(sz, 1);
-	if (!ret) {
+void *frameAlloc(size_t sz) {
+	size_t start = (frameArenaPtr + FRAME_ARENA_ALIGN - 1) & ~(size_t)(FRAME_ARENA_ALIGN - 1);
+	if (sz > FRAME_ARENA_SIZE - start) {
+		fail("Out of frame arena memory!\n");
+	}
+	frameArenaPtr = start + sz;
+	if (frameArenaPtr > frameArenaHigh)
+		frameArenaHigh = frameArenaPtr;
+	return frameArenaStart + start;
+}
+
+size_t frameMark(void) {
+	return frameArenaPtr;
+}
+
+void frameRewind(size_t mark) {
+#ifdef MEM_DEBUG
+	if (mark > frameArenaPtr) {
+		fail("Frame arena rewound past its top (%lu > %lu)\n", (unsigned long)mark, (unsigned long)frameArenaPtr);
+	}
+	memset(frameArenaStart + mark, FRAME_POISON, frameArenaPtr - mark);
+#endif
+	frameArenaPtr = mark;
+}
+
+void frameReset(void) {
+#ifdef MEM_DEBUG
+	if (frameArenaHigh > frameArenaReported) {
+		logDebug("Frame arena high-water mark: %lu bytes\n", (unsigned long)frameArenaHigh);
+		frameArenaReported = frameArenaHigh;
+	}
+#endif
+	frameRewind(0);
+}
+
+size_t frameHighWater(void) {
+	return frameArenaHigh;
+}
+
+/*
+ * Global heap
+ *
+ * Small allocations come from per size class free lists that are carved out of slabs,
+ * medium ones go to malloc and large ones are mapped directly.
+ * Every block starts with a header so globalDealloc knows where it came from.
+ */
+
+#define HEAP_SLAB_SIZE	0x10000 //64KB
+#define HEAP_LARGE_SIZE	0x40000 //256KB, blocks this big are mapped directly
+#define HEAP_CLASS_MEDIUM	HEAP_N_CLASSES
+#define HEAP_CLASS_LARGE	(HEAP_N_CLASSES + 1)
+
+struct HeapHeader {
+	uint32_t sizeClass;
+	uint32_t tag;
+	uint64_t size; /* Requested size */
+};
+
+struct HeapFree {
+	struct HeapFree *next;
+};
+
+static const uint32_t heapClassSizes[HEAP_N_CLASSES] = {
+	16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+static struct HeapFree *heapFreeLists[HEAP_N_CLASSES];
+static struct HeapClassStats heapStats[HEAP_N_CLASSES + 2];
+static volatile long heapLocks[HEAP_N_CLASSES + 2];
+
+#ifdef _MSC_VER
+#define memLock(l) do { while (_InterlockedExchange(l, 1)) _mm_pause(); } while (0)
+#define memUnlock(l) _InterlockedExchange(l, 0)
+#else
+#define memLock(l) do { while (__atomic_exchange_n(l, 1, __ATOMIC_ACQUIRE)) _mm_pause(); } while (0)
+#define memUnlock(l) __atomic_store_n(l, 0, __ATOMIC_RELEASE)
+#endif
+
+static unsigned int heapSizeClass(size_t sz) {
+	if (sz >= HEAP_LARGE_SIZE)
+		return HEAP_CLASS_LARGE;
+	for (unsigned int i = 0; i < HEAP_N_CLASSES; i++) {
+		if (sz <= heapClassSizes[i])
+			return i;
+	}
+	return HEAP_CLASS_MEDIUM;
+}
+
+static void *heapMap(size_t sz) {
+#ifdef _WIN32
+	void *ret = VirtualAlloc(NULL, sz, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+#else
+	void *ret = mmap(NULL, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ret == MAP_FAILED)
+		ret = NULL;
+#endif
+	return ret;
+}
+
+static void heapUnmap(void *mem, size_t sz) {
+#ifdef _WIN32
+	(void)sz;
+	VirtualFree(mem, 0, MEM_RELEASE);
+#else
+	munmap(mem, sz);
+#endif
+}
+
+/* Carve a new slab into blocks of a size class, called with the class lock held */
+static void heapAddSlab(unsigned int sizeClass) {
+	char *slab = malloc(HEAP_SLAB_SIZE);
+	if (!slab) {
 		fail("Out of memory!\n");
 	}
+	size_t blockSize = sizeof(struct HeapHeader) + heapClassSizes[sizeClass];
+	unsigned int nBlocks = HEAP_SLAB_SIZE / blockSize;
+	for (unsigned int i = 0; i < nBlocks; i++) {
+		struct HeapFree *f = (struct HeapFree *)(slab + i * blockSize);
+		f->next = heapFreeLists[sizeClass];
+		heapFreeLists[sizeClass] = f;
+	}
+	heapStats[sizeClass].slabs++;
+	heapStats[sizeClass].free += nBlocks;
+}
+
+/* Allocate a block, sets zeroed if the memory is known to be zero already */
+static void *heapAlloc(size_t sz, int tag, bool *zeroed) {
+	unsigned int sizeClass = heapSizeClass(sz);
+	struct HeapHeader *hdr;
+	*zeroed = false;
+	if (sizeClass < HEAP_N_CLASSES) {
+		memLock(&heapLocks[sizeClass]);
+		if (!heapFreeLists[sizeClass])
+			heapAddSlab(sizeClass);
+		hdr = (struct HeapHeader *)heapFreeLists[sizeClass];
+		heapFreeLists[sizeClass] = heapFreeLists[sizeClass]->next;
+		heapStats[sizeClass].free--;
+	} else {
+		if (sizeClass == HEAP_CLASS_LARGE) {
+			hdr = heapMap(sizeof(*hdr) + sz);
+			*zeroed = true;
+		} else {
+			hdr = malloc(sizeof(*hdr) + sz);
+		}
+		if (!hdr) {
+			fail("Out of memory!\n");
+		}
+		memLock(&heapLocks[sizeClass]);
+	}
+	heapStats[sizeClass].live++;
+	heapStats[sizeClass].liveBytes += sz;
+	heapStats[sizeClass].allocs++;
+	memUnlock(&heapLocks[sizeClass]);
+
+	hdr->sizeClass = sizeClass;
+	hdr->tag = tag;
+	hdr->size = sz;
+	tagAdd(tag, (long long)sz);
+	atomicInc(&tagFrameAllocs[tag]);
+	return hdr + 1;
+}
+
+void *globalAllocUninitTag(size_t sz, int tag) {
+	bool zeroed;
+	return heapAlloc(sz, tag, &zeroed);
+}
+
+void *globalAllocTag(size_t sz, int tag) {
+	bool zeroed;
+	void *ret = heapAlloc(sz, tag, &zeroed);
+	if (!zeroed)
+		memset(ret, 0, sz);
 	return ret;
 }
 
 void globalDealloc(void *mem) {
-	free(mem);
+	if (!mem)
+		return;
+	struct HeapHeader *hdr = (struct HeapHeader *)mem - 1;
+	unsigned int sizeClass = hdr->sizeClass;
+	size_t sz = hdr->size;
+	tagAdd(hdr->tag, -(long long)sz);
+
+	memLock(&heapLocks[sizeClass]);
+	heapStats[sizeClass].live--;
+	heapStats[sizeClass].liveBytes -= sz;
+	if (sizeClass < HEAP_N_CLASSES) {
+		struct HeapFree *f = (struct HeapFree *)hdr;
+		f->next = heapFreeLists[sizeClass];
+		heapFreeLists[sizeClass] = f;
+		heapStats[sizeClass].free++;
+	}
+	memUnlock(&heapLocks[sizeClass]);
+
+	if (sizeClass == HEAP_CLASS_LARGE) {
+		heapUnmap(hdr, sizeof(*hdr) + sz);
+	} else if (sizeClass == HEAP_CLASS_MEDIUM) {
+		free(hdr);
+	}
 }
 
-void *globalRealloc(void *mem, size_t newSz) {
-	void *ret = realloc(mem, newSz);
-	if (!ret) {
-		fail("Out of memory!\n");
+void *globalReallocTag(void *mem, size_t newSz, int tag) {
+	if (!mem)
+		return globalAllocUninitTag(newSz, tag);
+	struct HeapHeader *hdr = (struct HeapHeader *)mem - 1;
+	unsigned int sizeClass = heapSizeClass(newSz);
+	if (sizeClass == hdr->sizeClass && sizeClass < HEAP_N_CLASSES) {
+		/* Still fits in the same block */
+		tagAdd(hdr->tag, (long long)newSz - (long long)hdr->size);
+		memLock(&heapLocks[sizeClass]);
+		heapStats[sizeClass].liveBytes += newSz - hdr->size;
+		memUnlock(&heapLocks[sizeClass]);
+		hdr->size = newSz;
+		return mem;
 	}
+
+	if (sizeClass == HEAP_CLASS_MEDIUM && hdr->sizeClass == HEAP_CLASS_MEDIUM) {
+		size_t oldSz = hdr->size;
+		hdr = realloc(hdr, sizeof(*hdr) + newSz);
+		if (!hdr) {
+			fail("Out of memory!\n");
+		}
+		hdr->size = newSz;
+		tagAdd(hdr->tag, (long long)newSz - (long long)oldSz);
+		atomicInc(&tagFrameAllocs[hdr->tag]);
+		memLock(&heapLocks[sizeClass]);
+		heapStats[sizeClass].liveBytes += newSz - oldSz;
+		memUnlock(&heapLocks[sizeClass]);
+		return hdr + 1;
+	}
+
+	void *ret = globalAllocUninitTag(newSz, hdr->tag);
+	memcpy(ret, mem, newSz < hdr->size ? newSz : (size_t)hdr->size);
+	globalDealloc(mem);
 	return ret;
 }
 
+void heapGetStats(struct HeapClassStats *out) {
+	for (unsigned int i = 0; i < HEAP_N_CLASSES + 2; i++) {
+		memLock(&heapLocks[i]);
+		out[i] = heapStats[i];
+		memUnlock(&heapLocks[i]);
+		out[i].objSize = i < HEAP_N_CLASSES ? heapClassSizes[i] : 0;
+	}
+}
+
+/*
+ * Tags
+ */
+
+const char *memTagName(int tag) {
+	return tagNames[tag];
+}
+
+void memTagFrameEnd(struct MemTagStats *out) {
+	for (int i = 0; i < MEM_TAG_COUNT; i++) {
+		tagLastFrame[i].liveBytes = (size_t)tagLive[i];
+		tagLastFrame[i].peakBytes = (size_t)tagPeak[i];
+#ifdef _MSC_VER
+		tagLastFrame[i].frameAllocs = (unsigned int)_InterlockedExchange(&tagFrameAllocs[i], 0);
+#else
+		tagLastFrame[i].frameAllocs = (unsigned int)__atomic_exchange_n(&tagFrameAllocs[i], 0, __ATOMIC_RELAXED);
+#endif
+		if (out)
+			out[i] = tagLastFrame[i];
+	}
+}
+
+void memDumpTags(void) {
+	logNorm("Memory tag        live KB    peak KB  allocs/frame\n");
+	for (int i = 0; i < MEM_TAG_COUNT; i++) {
+		logNorm("%-12s %10lu %10lu %13u\n", tagNames[i], (unsigned long)(tagLastFrame[i].liveBytes / 1024),
+			(unsigned long)(tagLastFrame[i].peakBytes / 1024), tagLastFrame[i].frameAllocs);
+	}
+	cacheDumpStats();
+}
+
 /*
  * Cache
  */
@@ -63,16 +383,78 @@ void *globalRealloc(void *mem, size_t newSz) {
 #define CACHE_MAX_OBJ_SIZE	(CACHE_BLOCK_SIZE / 16)
 #define CACHE_ALIGN			8
 
+/* Per-thread magazines: a few objects of a cache that a thread can get and release without taking the lock */
+#define CACHE_MAX_CACHES	32
+#define CACHE_MAGAZINE_SIZE	16
+
+/* Pages are aligned to their size so an object can find its page */
 struct CachePage {
 	struct CachePage *next;
-	void *unused;
+	struct CachePage *prev;
+	struct CacheEntry *free;
+	unsigned int used; /* Objects handed out, including those sitting in magazines */
 };
 
 struct CacheEntry {
 	struct CacheEntry *next;
 };
 
-void cacheCreate(struct Cache * newCache, size_t size, const char * name) {
+struct CacheMagazine {
+	struct Cache *cache;
+	unsigned int gen;
+	unsigned int count;
+	void *objs[CACHE_MAGAZINE_SIZE];
+};
+
+static struct Cache *cacheRegistry[CACHE_MAX_CACHES];
+static volatile long cacheRegistryLock;
+static volatile long cacheGenNext; /* Generations are unique across caches so a stale magazine never matches */
+static THREAD_LOCAL struct CacheMagazine cacheMagazines[CACHE_MAX_CACHES];
+
+static void *pageAlloc(void) {
+#ifdef _MSC_VER
+	void *ret = _aligned_malloc(CACHE_BLOCK_SIZE, CACHE_BLOCK_SIZE);
+#else
+	void *ret;
+	if (posix_memalign(&ret, CACHE_BLOCK_SIZE, CACHE_BLOCK_SIZE))
+		ret = NULL;
+#endif
+	if (!ret) {
+		fail("Out of memory!\n");
+	}
+	return ret;
+}
+
+static void pageFree(void *page) {
+#ifdef _MSC_VER
+	_aligned_free(page);
+#else
+	free(page);
+#endif
+}
+
+static inline struct CachePage *cachePageOf(void *obj) {
+	return (struct CachePage *)((uintptr_t)obj & ~(uintptr_t)(CACHE_BLOCK_SIZE - 1));
+}
+
+static void cacheListRemove(struct CachePage **list, struct CachePage *page) {
+	if (page->prev)
+		page->prev->next = page->next;
+	else
+		*list = page->next;
+	if (page->next)
+		page->next->prev = page->prev;
+}
+
+static void cacheListAdd(struct CachePage **list, struct CachePage *page) {
+	page->prev = NULL;
+	page->next = *list;
+	if (*list)
+		(*list)->prev = page;
+	*list = page;
+}
+
+void cacheCreateTag(struct Cache * newCache, size_t size, const char * name, int tag) {
 #ifdef CACHE_ALIGN
 	if (size < CACHE_ALIGN) {
 		size = CACHE_ALIGN;
@@ -92,48 +474,218 @@ void cacheCreate(struct Cache * newCache, size_t size, const char * name) {
 	memset(newCache, 0, sizeof(*newCache));
 	newCache->name = name;
 	newCache->objSize = size;
+	newCache->tag = tag;
+	newCache->maxEmptyPages = 1;
+	newCache->gen = (unsigned int)atomicInc(&cacheGenNext);
+
+	/* Caches past the registry size still work, just without magazines */
+	newCache->id = -1;
+	memLock(&cacheRegistryLock);
+	for (int i = 0; i < CACHE_MAX_CACHES; i++) {
+		if (!cacheRegistry[i]) {
+			cacheRegistry[i] = newCache;
+			newCache->id = i;
+			break;
+		}
+	}
+	memUnlock(&cacheRegistryLock);
 }
 
-void cachePurge(struct Cache *cache) {
-	struct CachePage *block = cache->pList;
-	while (block) {
-		struct CachePage *next = block->next;
-		globalDealloc(block);
-		block = next;
+void cacheSetWatermark(struct Cache *cache, unsigned int maxEmptyPages) {
+	memLock(&cache->lock);
+	cache->maxEmptyPages = maxEmptyPages;
+	memUnlock(&cache->lock);
+}
+
+static void cacheFreePages(struct Cache *cache, struct CachePage *page) {
+	while (page) {
+		struct CachePage *next = page->next;
+		pageFree(page);
+		tagAdd(cache->tag, -CACHE_BLOCK_SIZE);
+		page = next;
 	}
-	cache->pList = NULL;
-	cache->list = NULL;
+}
+
+void cachePurge(struct Cache *cache) {
+	memLock(&cache->lock);
+	cacheFreePages(cache, cache->partial);
+	cacheFreePages(cache, cache->full);
+	cache->partial = NULL;
+	cache->full = NULL;
+	cache->stats.pages = 0;
+	cache->stats.emptyPages = 0;
+	cache->stats.live = 0;
+	cache->gen = (unsigned int)atomicInc(&cacheGenNext); /* Magazines still holding objects from the freed pages drop them */
+	memUnlock(&cache->lock);
+}
+
+void cacheDestroy(struct Cache *cache) {
+	cachePurge(cache);
+	memLock(&cacheRegistryLock);
+	if (cache->id >= 0)
+		cacheRegistry[cache->id] = NULL;
+	memUnlock(&cacheRegistryLock);
+	cache->id = -1;
 }
 
 static void addNewPage(struct Cache *cache) {
-	struct CachePage *block = globalAlloc(CACHE_BLOCK_SIZE);
-	block->next = cache->pList;
-	cache->pList = block;
+	struct CachePage *page = pageAlloc();
+	tagAdd(cache->tag, CACHE_BLOCK_SIZE);
+	page->used = 0;
+	page->free = NULL;
 
-	uintptr_t p2 = (uintptr_t)(block + 1);
+	uintptr_t p2 = (uintptr_t)(page + 1);
 	uint32_t nEntries = (uint32_t)((CACHE_BLOCK_SIZE - sizeof(struct CachePage)) / cache->objSize);
+	p2 += (nEntries - 1) * cache->objSize;
 	for (uint32_t i = 0; i < nEntries; i++) {
+		/* Build the list backwards so objects are handed out in address order */
 		struct CacheEntry *en = (struct CacheEntry *)(p2);
-		en->next = cache->list;
-		cache->list = en;
-		p2 += cache->objSize;
+		en->next = page->free;
+		page->free = en;
+		p2 -= cache->objSize;
 	}
+	cacheListAdd(&cache->partial, page);
+	cache->stats.pages++;
+	cache->stats.emptyPages++;
 }
 
-void *cacheGet(struct Cache *cache) {
-	struct CacheEntry *en = cache->list;
-	if (!en) {
+/* Take an object from the pages, called with the cache lock held */
+static void *cacheTake(struct Cache *cache) {
+	struct CachePage *page = cache->partial;
+	if (!page) {
 		addNewPage(cache);
-		en = cache->list;
+		page = cache->partial;
 	}
-	cache->list = en->next;
+	struct CacheEntry *en = page->free;
+	page->free = en->next;
+	if (!page->used++)
+		cache->stats.emptyPages--;
+	if (!page->free) {
+		cacheListRemove(&cache->partial, page);
+		cacheListAdd(&cache->full, page);
+	}
+	cache->stats.live++;
 	return en;
 }
 
-void cacheRelease(struct Cache * cache, void * obj) {
+/* Return an object to its page, called with the cache lock held */
+static void cacheGive(struct Cache *cache, void *obj) {
+	struct CachePage *page = cachePageOf(obj);
 	struct CacheEntry *en = obj;
-	en->next = cache->list;
-	cache->list = en;
+	if (!page->free) {
+		cacheListRemove(&cache->full, page);
+		cacheListAdd(&cache->partial, page);
+	}
+	en->next = page->free;
+	page->free = en;
+	cache->stats.live--;
+	if (--page->used)
+		return;
+
+	/* Page is empty, give it back if there are enough spare pages already */
+	if (cache->stats.emptyPages >= cache->maxEmptyPages) {
+		cacheListRemove(&cache->partial, page);
+		pageFree(page);
+		tagAdd(cache->tag, -CACHE_BLOCK_SIZE);
+		cache->stats.pages--;
+		cache->stats.pagesFreed++;
+	} else {
+		cache->stats.emptyPages++;
+	}
+}
+
+static struct CacheMagazine *cacheMagazine(struct Cache *cache) {
+	if (cache->id < 0)
+		return NULL;
+	struct CacheMagazine *mag = &cacheMagazines[cache->id];
+	if (mag->cache != cache || mag->gen != cache->gen) {
+		/* First use on this thread, or the objects in it were purged */
+		mag->cache = cache;
+		mag->gen = cache->gen;
+		mag->count = 0;
+	}
+	return mag;
+}
+
+void *cacheGet(struct Cache *cache) {
+	atomicInc(&tagFrameAllocs[cache->tag]);
+	atomicInc(&cache->gets);
+	struct CacheMagazine *mag = cacheMagazine(cache);
+	if (mag && mag->count)
+		return mag->objs[--mag->count];
+
+	memLock(&cache->lock);
+	void *ret = cacheTake(cache);
+	if (mag) {
+		/* Refill half the magazine while holding the lock anyway */
+		while (mag->count < CACHE_MAGAZINE_SIZE / 2) {
+			mag->objs[mag->count++] = cacheTake(cache);
+		}
+	}
+	memUnlock(&cache->lock);
+	return ret;
+}
+
+void cacheRelease(struct Cache * cache, void * obj) {
+	atomicInc(&cache->releases);
+	struct CacheMagazine *mag = cacheMagazine(cache);
+	if (mag && mag->count < CACHE_MAGAZINE_SIZE) {
+		mag->objs[mag->count++] = obj;
+		return;
+	}
+
+	memLock(&cache->lock);
+	cacheGive(cache, obj);
+	if (mag) {
+		/* Magazine is full, send half of it back */
+		while (mag->count > CACHE_MAGAZINE_SIZE / 2) {
+			cacheGive(cache, mag->objs[--mag->count]);
+		}
+	}
+	memUnlock(&cache->lock);
+}
+
+/* Return the calling thread's magazines to their caches */
+static void cacheThreadFlush(void) {
+	memLock(&cacheRegistryLock);
+	for (int i = 0; i < CACHE_MAX_CACHES; i++) {
+		struct CacheMagazine *mag = &cacheMagazines[i];
+		struct Cache *cache = cacheRegistry[i];
+		if (mag->count && cache == mag->cache && cache->gen == mag->gen) {
+			memLock(&cache->lock);
+			while (mag->count) {
+				cacheGive(cache, mag->objs[--mag->count]);
+			}
+			memUnlock(&cache->lock);
+		}
+		mag->cache = NULL;
+		mag->count = 0;
+	}
+	memUnlock(&cacheRegistryLock);
+}
+
+void cacheGetStats(struct Cache *cache, struct CacheStats *out) {
+	memLock(&cache->lock);
+	*out = cache->stats;
+	memUnlock(&cache->lock);
+	out->objSize = cache->objSize;
+	out->gets = (unsigned long)cache->gets;
+	out->releases = (unsigned long)cache->releases;
+}
+
+void cacheDumpStats(void) {
+	logNorm("Cache                objsize   live  pages  empty  freed\n");
+	memLock(&cacheRegistryLock);
+	for (int i = 0; i < CACHE_MAX_CACHES; i++) {
+		struct Cache *cache = cacheRegistry[i];
+		if (!cache)
+			continue;
+		struct CacheStats st;
+		cacheGetStats(cache, &st);
+		logNorm("%-20s %7lu %6lu %6u %6u %6lu\n", cache->name, (unsigned long)st.objSize, (unsigned long)st.live,
+			st.pages, st.emptyPages, (unsigned long)st.pagesFreed);
+	}
+	memUnlock(&cacheRegistryLock);
 }
 
 
@@ -157,14 +709,35 @@ void vecDestroy(struct Vector *vec) {
 	vec->data = NULL;
 }
 
-void *vecInsert(struct Vector *vec, int pos) {
+void vecReserve(struct Vector *vec, unsigned int n) {
 	assert(vec->elementSize);
-	if (vec->nElements == vec->nAllocations) {
-		/* Allocate new */
-		unsigned int newAllocations = (vec->nAllocations == 0) ? 1 : vec->nAllocations * 2;
-		vec->data = globalRealloc(vec->data, newAllocations * vec->elementSize);
-		vec->nAllocations = newAllocations;
+	if (n <= vec->nAllocations)
+		return;
+	vec->data = globalRealloc(vec->data, n * vec->elementSize);
+	vec->nAllocations = n;
+}
+
+static void vecGrow(struct Vector *vec, unsigned int n) {
+	if (n <= vec->nAllocations)
+		return;
+	unsigned int newAllocations = (vec->nAllocations == 0) ? 1 : vec->nAllocations * 2;
+	vecReserve(vec, newAllocations < n ? n : newAllocations);
+}
+
+void vecShrink(struct Vector *vec) {
+	if (vec->nElements == vec->nAllocations)
+		return;
+	if (!vec->nElements) {
+		vecClear(vec);
+		return;
 	}
+	vec->data = globalRealloc(vec->data, vec->nElements * vec->elementSize);
+	vec->nAllocations = vec->nElements;
+}
+
+void *vecInsert(struct Vector *vec, int pos) {
+	assert(vec->elementSize);
+	vecGrow(vec, vec->nElements + 1);
 	if (pos < 0) {
 		pos = vec->nElements;
 	} else {
@@ -175,12 +748,29 @@ void *vecInsert(struct Vector *vec, int pos) {
 	return &vec->data[pos * vec->elementSize];
 }
 
+void *vecAppend(struct Vector *vec, const void *elements, unsigned int n) {
+	assert(vec->elementSize);
+	vecGrow(vec, vec->nElements + n);
+	char *dst = &vec->data[vec->nElements * vec->elementSize];
+	if (elements)
+		memcpy(dst, elements, n * vec->elementSize);
+	vec->nElements += n;
+	return dst;
+}
+
 void vecDelete(struct Vector *vec, unsigned int index) {
 	memmove(&vec->data[index * vec->elementSize], &vec->data[(index + 1) * vec->elementSize],
 		(vec->nElements - index - 1) * vec->elementSize);
 	vec->nElements -= 1;
 }
 
+void vecSwapDelete(struct Vector *vec, unsigned int index) {
+	unsigned int last = vec->nElements - 1;
+	if (index != last)
+		memcpy(&vec->data[index * vec->elementSize], &vec->data[last * vec->elementSize], vec->elementSize);
+	vec->nElements = last;
+}
+
 void vecClear(struct Vector *vec) {
 	if (vec->data)
 		globalDealloc(vec->data);
@@ -243,3 +833,237 @@ void HTDestroy(struct HashTable *tbl) {
 }
 
 
+
+
+/*
+Hash map
+*/
+
+uint32_t hashString(const char *key) {
+	const uint8_t *c = (const uint8_t *)key;
+	uint32_t h = 2166136261u;
+	while (*c) {
+		h ^= *c++;
+		h *= 16777619u;
+	}
+	return h ? h : 1;
+}
+
+static void hashMapAlloc(struct HashMap *map, unsigned int capacity) {
+	map->capacity = capacity;
+	map->count = 0;
+	map->hashes = globalAlloc(capacity * sizeof(uint32_t));
+	map->slots = globalAllocUninit(capacity * sizeof(struct HashMapSlot));
+}
+
+void hashMapCreate(struct HashMap *map, unsigned int size) {
+	unsigned int capacity = 16;
+	while (capacity - capacity / 4 < size) {
+		capacity *= 2;
+	}
+	hashMapAlloc(map, capacity);
+}
+
+void hashMapDestroy(struct HashMap *map) {
+	globalDealloc(map->hashes);
+	globalDealloc(map->slots);
+	map->hashes = NULL;
+	map->slots = NULL;
+	map->capacity = 0;
+	map->count = 0;
+}
+
+static unsigned int hashMapFind(struct HashMap *map, const char *key, uint32_t hash) {
+	unsigned int mask = map->capacity - 1;
+	unsigned int i = hash & mask;
+	while (map->hashes[i]) {
+		if (map->hashes[i] == hash && !strcmp(map->slots[i].key, key)) {
+			return i;
+		}
+		i = (i + 1) & mask;
+	}
+	return ~0U;
+}
+
+void *hashMapGetHashed(struct HashMap *map, const char *key, uint32_t hash) {
+	if (!map->capacity) {
+		return NULL;
+	}
+	unsigned int i = hashMapFind(map, key, hash);
+	return i != ~0U ? map->slots[i].value : NULL;
+}
+
+static void hashMapGrow(struct HashMap *map) {
+	uint32_t *oldHashes = map->hashes;
+	struct HashMapSlot *oldSlots = map->slots;
+	unsigned int oldCapacity = map->capacity;
+	unsigned int count = map->count;
+
+	hashMapAlloc(map, oldCapacity ? oldCapacity * 2 : 16);
+	map->count = count;
+	unsigned int mask = map->capacity - 1;
+	for (unsigned int i = 0; i < oldCapacity; i++) {
+		if (!oldHashes[i]) {
+			continue;
+		}
+		unsigned int j = oldHashes[i] & mask;
+		while (map->hashes[j]) {
+			j = (j + 1) & mask;
+		}
+		map->hashes[j] = oldHashes[i];
+		map->slots[j] = oldSlots[i];
+	}
+	globalDealloc(oldHashes);
+	globalDealloc(oldSlots);
+}
+
+void hashMapPutHashed(struct HashMap *map, const char *key, uint32_t hash, void *value) {
+	assert(hash);
+	if ((map->count + 1) * 4 > map->capacity * 3) {
+		hashMapGrow(map);
+	}
+	unsigned int mask = map->capacity - 1;
+	unsigned int i = hash & mask;
+	while (map->hashes[i]) {
+		if (map->hashes[i] == hash && !strcmp(map->slots[i].key, key)) {
+			map->slots[i].value = value;
+			return;
+		}
+		i = (i + 1) & mask;
+	}
+	map->hashes[i] = hash;
+	map->slots[i].key = key;
+	map->slots[i].value = value;
+	map->count++;
+}
+
+void *hashMapRemove(struct HashMap *map, const char *key) {
+	if (!map->capacity) {
+		return NULL;
+	}
+	unsigned int i = hashMapFind(map, key, hashString(key));
+	if (i == ~0U) {
+		return NULL;
+	}
+	void *value = map->slots[i].value;
+
+	/* Backward shift: pull later entries of the same cluster into the hole so no tombstones are needed */
+	unsigned int mask = map->capacity - 1;
+	unsigned int j = i;
+	while (1) {
+		j = (j + 1) & mask;
+		if (!map->hashes[j]) {
+			break;
+		}
+		unsigned int home = map->hashes[j] & mask;
+		/* Entry at j may move to i if its home slot is not in (i, j] */
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			map->hashes[i] = map->hashes[j];
+			map->slots[i] = map->slots[j];
+			i = j;
+		}
+	}
+	map->hashes[i] = 0;
+	map->count--;
+	return value;
+}
+
+struct HashMapSlot *hashMapNext(struct HashMap *map, unsigned int *it) {
+	while (*it < map->capacity) {
+		unsigned int i = (*it)++;
+		if (map->hashes[i]) {
+			return &map->slots[i];
+		}
+	}
+	return NULL;
+}
+
+
+/*
+String interner
+*/
+
+#define STR_BLOCK_SIZE 0x10000
+#define STR_PAGE_SHIFT 10
+#define STR_PAGE_SIZE (1 << STR_PAGE_SHIFT)
+#define STR_PAGE_MASK (STR_PAGE_SIZE - 1)
+#define STR_MAX_PAGES 1024
+
+static volatile long strLock;
+static struct HashMap strMap; /* Interned copy -> id */
+static const char **strPages[STR_MAX_PAGES]; /* id -> interned copy, pages never move so strName needs no lock */
+static strid_t strNext = 1;
+static char *strBlock;
+static size_t strBlockUsed = STR_BLOCK_SIZE;
+
+static strid_t strInternLocked(const char *str, size_t len, uint32_t hash) {
+	void *found = hashMapGetHashed(&strMap, str, hash);
+	if (found) {
+		return (strid_t)(uintptr_t)found;
+	}
+
+	strid_t id = strNext;
+	if ((id >> STR_PAGE_SHIFT) >= STR_MAX_PAGES) {
+		fail("String interner full\n");
+		return STR_NONE;
+	}
+	if (!strPages[id >> STR_PAGE_SHIFT]) {
+		strPages[id >> STR_PAGE_SHIFT] = globalAllocUninit(STR_PAGE_SIZE * sizeof(const char *));
+	}
+
+	/* Copies are packed into blocks that are never freed, long strings get their own */
+	char *copy;
+	if (len + 1 > STR_BLOCK_SIZE / 16) {
+		copy = globalAllocUninit(len + 1);
+	} else {
+		if (strBlockUsed + len + 1 > STR_BLOCK_SIZE) {
+			strBlock = globalAllocUninit(STR_BLOCK_SIZE);
+			strBlockUsed = 0;
+		}
+		copy = &strBlock[strBlockUsed];
+		strBlockUsed += len + 1;
+	}
+	memcpy(copy, str, len);
+	copy[len] = 0;
+
+	strPages[id >> STR_PAGE_SHIFT][id & STR_PAGE_MASK] = copy;
+	hashMapPutHashed(&strMap, copy, hash, (void *)(uintptr_t)id);
+	strNext = id + 1;
+	return id;
+}
+
+strid_t strIntern(const char *str) {
+	uint32_t hash = hashString(str);
+	memLock(&strLock);
+	strid_t id = strInternLocked(str, strlen(str), hash);
+	memUnlock(&strLock);
+	return id;
+}
+
+strid_t strInternLen(const char *str, size_t len) {
+	/* The map compares NUL terminated keys */
+	char buf[256];
+	char *key = len < sizeof(buf) ? buf : stackAlloc(len + 1);
+	memcpy(key, str, len);
+	key[len] = 0;
+	strid_t id = strIntern(key);
+	if (key != buf) {
+		stackDealloc(len + 1);
+	}
+	return id;
+}
+
+strid_t strLookup(const char *str) {
+	uint32_t hash = hashString(str);
+	memLock(&strLock);
+	void *found = hashMapGetHashed(&strMap, str, hash);
+	memUnlock(&strLock);
+	return (strid_t)(uintptr_t)found;
+}
+
+const char *strName(strid_t id) {
+	if (id == STR_NONE) {
+		return NULL;
+	}
+	return strPages[id >> STR_PAGE_SHIFT][id & STR_PAGE_MASK];
+}
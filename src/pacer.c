@@ -0,0 +1,204 @@
+#ifndef _WIN32
+#define _DEFAULT_SOURCE
+#endif
+#include "system_events.h"
+
+#include <SDL2/SDL.h>
+#include <immintrin.h>
+#include <math.h>
+#include <assets.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <errno.h>
+#endif
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+/*
+ * The pacer sleeps until shortly before the deadline and spins the rest. How much earlier it wakes up
+ * (the slack) follows the measured oversleep of the OS timer, mean plus two deviations.
+ * Linux sleeps are precise enough to keep the spin under 100us, Windows timers are not.
+ */
+#ifdef _WIN32
+#define PACER_MAX_SLACK_US 2000
+#else
+#define PACER_MAX_SLACK_US 100
+#endif
+#define PACER_MIN_SLACK_US 10
+#define PACER_SLACK_SHIFT 4 /* Oversleep average over about 16 frames */
+
+struct FramePacing framePacing;
+
+static double freqUs; /* Performance counter ticks per microsecond */
+static double slackMean; /* Oversleep in ticks */
+static double slackVar;
+static uint64_t slack;
+
+/* Statistics since the last publish */
+static uint64_t statStart;
+static double cpuStart;
+static unsigned int statFrames;
+static unsigned int statMissed;
+static double statJitter;
+static double statWorst;
+static double statSpin;
+
+#ifdef _WIN32
+static HANDLE sleepTimer;
+
+static void pacerSleep(uint64_t ticks) {
+	/* Relative due time in 100ns units */
+	LARGE_INTEGER due;
+	due.QuadPart = -(LONGLONG)(ticks / freqUs * 10);
+	if (sleepTimer && SetWaitableTimer(sleepTimer, &due, 0, NULL, NULL, FALSE)) {
+		WaitForSingleObject(sleepTimer, INFINITE);
+	} else {
+		SDL_Delay((Uint32)(ticks / freqUs / 1000));
+	}
+}
+
+static double threadCpuUs(void) {
+	FILETIME creation, exited, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exited, &kernel, &user)) {
+		return -1;
+	}
+	uint64_t k = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	uint64_t u = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+	return (double)(k + u) / 10;
+}
+#else
+static void pacerSleep(uint64_t ticks) {
+	uint64_t ns = (uint64_t)(ticks / freqUs * 1000);
+#ifdef __APPLE__
+	struct timespec ts = { ns / 1000000000, ns % 1000000000 };
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
+#else
+	/* Absolute wake-up time, so an interrupted sleep does not drift */
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	ns += ts.tv_nsec;
+	ts.tv_sec += ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {}
+#endif
+}
+
+static double threadCpuUs(void) {
+	struct timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts)) {
+		return -1;
+	}
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+#endif
+
+static void pacerUpdateSlack(double over) {
+	double d = over - slackMean;
+	slackMean += d / (1 << PACER_SLACK_SHIFT);
+	slackVar += (d * d - slackVar) / (1 << PACER_SLACK_SHIFT);
+
+	double s = slackMean + 2 * sqrt(slackVar);
+	if (s < PACER_MIN_SLACK_US * freqUs)
+		s = PACER_MIN_SLACK_US * freqUs;
+	if (s > PACER_MAX_SLACK_US * freqUs)
+		s = PACER_MAX_SLACK_US * freqUs;
+	slack = (uint64_t)s;
+}
+
+static void pacerPublish(uint64_t now) {
+	if (now - statStart < (uint64_t)(freqUs * 1e6))
+		return;
+	double wall = (now - statStart) / freqUs;
+	double cpu = threadCpuUs();
+	unsigned int waited = statFrames - statMissed;
+
+	framePacing.jitterUs = waited ? statJitter / waited : 0;
+	framePacing.worstLateUs = statWorst;
+	framePacing.slackUs = slack / freqUs;
+	framePacing.spinUs = waited ? statSpin / waited : 0;
+	framePacing.cpuUsage = (cpu >= 0 && cpuStart >= 0) ? (cpu - cpuStart) / wall : -1;
+	framePacing.missed = statMissed;
+
+	statStart = now;
+	cpuStart = cpu;
+	statFrames = 0;
+	statMissed = 0;
+	statJitter = 0;
+	statWorst = 0;
+	statSpin = 0;
+}
+
+void pacerInit(void) {
+	freqUs = SDL_GetPerformanceFrequency() / 1e6;
+	slackMean = PACER_MAX_SLACK_US * freqUs / 2;
+	slackVar = 0;
+	pacerUpdateSlack(slackMean);
+
+#ifdef _WIN32
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+	sleepTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+	if (!sleepTimer) {
+		/* Before Windows 10 1803 */
+		sleepTimer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+	}
+#endif
+#ifdef __linux__
+	/* The default 50us timer slack of the main thread would eat most of the spin budget */
+	prctl(PR_SET_TIMERSLACK, 1UL, 0, 0, 0);
+#endif
+
+	statStart = SDL_GetPerformanceCounter();
+	cpuStart = threadCpuUs();
+}
+
+void pacerFini(void) {
+#ifdef _WIN32
+	if (sleepTimer) {
+		CloseHandle(sleepTimer);
+		sleepTimer = NULL;
+	}
+#endif
+}
+
+bool pacerWait(uint64_t deadline) {
+	uint64_t now = SDL_GetPerformanceCounter();
+	statFrames++;
+	if (now >= deadline) {
+		statMissed++;
+		pacerPublish(now);
+		return false;
+	}
+
+	if (deadline - now > slack) {
+		uint64_t wake = deadline - slack;
+		pacerSleep(wake - now);
+		now = SDL_GetPerformanceCounter();
+		pacerUpdateSlack(now > wake ? (double)(now - wake) : 0);
+	}
+
+	uint64_t spinStart = now;
+	while (now < deadline) {
+		_mm_pause();
+		now = SDL_GetPerformanceCounter();
+	}
+
+	double late = (now - deadline) / freqUs;
+	statJitter += late;
+	if (late > statWorst)
+		statWorst = late;
+	statSpin += (now > spinStart ? now - spinStart : 0) / freqUs;
+	pacerPublish(now);
+	return true;
+}
+
+void pacerDumpStats(void) {
+	logNorm("Frame pacing: jitter %.1fus worst %.1fus slack %.1fus spin %.1fus cpu %.1f%% missed %u\n",
+		framePacing.jitterUs, framePacing.worstLateUs, framePacing.slackUs, framePacing.spinUs,
+		framePacing.cpuUsage * 100, framePacing.missed);
+}
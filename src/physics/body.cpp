@@ -112,25 +112,32 @@ void physBodySetVelocity(struct PhysBody *b, const Vec *vel) {
 
 
 void joltBodyUpdatePre(BodyInterface &bi) {
-	for (auto b = PHYS_BODIES.begin(); b != PHYS_BODIES.end(); ++b) {
+	/* Kinematic bodies also get pushed the step after their last move, so MoveKinematic brings them to a stop */
+	static uint32_t tfTick, tfTickPrev;
+	uint32_t since = tfTick, sinceKinematic = tfTickPrev;
+	tfTickPrev = tfTick;
+	tfTick = ecsAdvanceChangeTick();
+
+	for (auto [b, tf] : clView(PHYS_BODIES, TRANSFORMS)) {
 		if (b->flags & PHYS_FLAG_SYNC_FROM_TF) {
-			Transform *tf = getTf(b->entity);
+			bool always = !(b->flags & PHYS_FLAG_SYNC_CHANGED);
 			if (b->flags & PHYS_FLAG_KINEMATIC) {
-				bi.MoveKinematic(getJBody(b.ptr()), RVec3{ tf->x, tf->y, tf->z }, Quat{ tf->rx, tf->ry, tf->rz, tf->rw }, PHYS_DELTATIME);
-			} else {
-				bi.SetPositionAndRotation(getJBody(b.ptr()), RVec3{ tf->x, tf->y, tf->z }, Quat{ tf->rx, tf->ry, tf->rz, tf->rw }, EActivation::DontActivate);
+				if (always || TRANSFORMS.changedSince(b->entity, sinceKinematic))
+					bi.MoveKinematic(getJBody(b), RVec3{ tf->x, tf->y, tf->z }, Quat{ tf->rx, tf->ry, tf->rz, tf->rw }, PHYS_DELTATIME);
+			} else if (always || TRANSFORMS.changedSince(b->entity, since)) {
+				bi.SetPositionAndRotation(getJBody(b), RVec3{ tf->x, tf->y, tf->z }, Quat{ tf->rx, tf->ry, tf->rz, tf->rw }, EActivation::DontActivate);
 			}
 		}
 	}
 }
 
 void joltBodyUpdatePost(BodyInterface &bi) {
-	for (auto b = PHYS_BODIES.begin(); b != PHYS_BODIES.end(); ++b) {
+	for (auto [b, tf] : clView(PHYS_BODIES, TRANSFORMS)) {
 		if (b->flags & PHYS_FLAG_SYNC_TO_TF) {
-			Transform *tf = getTf(b->entity);
 			RVec3 pos;
 			Quat rot;
-			bi.GetPositionAndRotation(getJBody(b.ptr()), pos, rot);
+			bi.GetPositionAndRotation(getJBody(b), pos, rot);
+			TRANSFORMS.markChanged(b->entity);
 			tf->x = pos.GetX();
 			tf->y = pos.GetY();
 			tf->z = pos.GetZ();
@@ -188,6 +195,8 @@ static void physBodyNotifier(void *arg, void *component, int type) {
 void joltBodyInit(void) {
 	componentListInitSz(PHYS_BODY, sizeof(PhysBody));
 	setNotifier(PHYS_BODY, physBodyNotifier, nullptr);
+	/* Jolt owns the body state, bodies keep their entities across a restore */
+	componentListAllowSnapshot(PHYS_BODY, false);
 }
 
 void joltBodyFini(void) {
@@ -99,7 +99,7 @@ static void charNormalUpdate(BodyInterface &bi, PhysCharacter *ch) {
 	ch->vel.y = vel.GetY();
 	ch->vel.z = vel.GetZ();
 
-	Transform *tf = getTf(ch->entity);
+	Transform *tf = getTfMut(ch->entity);
 	JPH::Vec3 pos = jch->GetPosition();
 	tf->x = pos.GetX();
 	tf->y = pos.GetY();
@@ -162,7 +162,7 @@ CharVirtShapeFilter charVirtShapeFilter;
 
 
 static void charVirtualUpdate(BodyInterface &bi, PhysCharacter *ch) {
-	Transform *tf = getTf(ch->entity);
+	Transform *tf = getTfMut(ch->entity);
 
 	CharacterVirtual *c = static_cast<CharacterVirtual *>(ch->joltCharacter);
 	CharacterVirtual::ExtendedUpdateSettings settings;
@@ -251,6 +251,7 @@ static void physCharacterNotifier(void *arg, void *component, int type) {
 void joltCharacterInit(void) {
 	componentListInitSz(PHYS_CHARACTER, sizeof(PhysCharacter));
 	setNotifier(PHYS_CHARACTER, physCharacterNotifier, nullptr);
+	componentListAllowSnapshot(PHYS_CHARACTER, false);
 }
 
 void joltCharacterFini(void) {
@@ -1,9 +1,11 @@
+#define MEM_TAG MEM_TAG_PHYSICS
 #include "jolt.h"
 #include <physics/3d.h>
 #include <assets.h>
 #include <basics.h>
 #include <gfx/draw.h> // for model files and debug render
 #include <events.h>
+#include <prof.h>
 
 #define DRAW_PHYS_DEBUG 499
 
@@ -257,9 +259,10 @@ public:
 	}
 	virtual Batch CreateTriangleBatch(const Triangle *inTriangles, int inTriangleCount) {
 		int nVerts = inTriangleCount * 3;
-		Vertex *verts = (Vertex *)stackAlloc(nVerts * sizeof(Vertex));
+		size_t mark = frameMark();
+		Vertex *verts = (Vertex *)frameAlloc(nVerts * sizeof(Vertex));
 		int nIdx = nVerts;
-		uint32_t *idx = (uint32_t *)stackAlloc(nIdx * sizeof(uint32_t));
+		uint32_t *idx = (uint32_t *)frameAlloc(nIdx * sizeof(uint32_t));
 		for (int i = 0; i < inTriangleCount; i++) {
 			verts[i * 3 + 0] = inTriangles[i].mV[0];
 			verts[i * 3 + 1] = inTriangles[i].mV[1];
@@ -269,11 +272,13 @@ public:
 			idx[i * 3 + 1] = i * 3 + 1;
 			idx[i * 3 + 2] = i * 3 + 2;
 		}
-		return CreateTriangleBatch(verts, nVerts, idx, nIdx);
+		Batch batch = CreateTriangleBatch(verts, nVerts, idx, nIdx);
+		frameRewind(mark);
+		return batch;
 	}
 	virtual Batch CreateTriangleBatch(const Vertex *inVertices, int inVertexCount, const uint32 *inIndices, int inIndexCount) {
 		MyTriangleBatch *batch = new MyTriangleBatch();
-		batch->vertices = (MyVertex *)globalAlloc(inVertexCount * sizeof(MyVertex));
+		batch->vertices = (MyVertex *)globalAllocUninit(inVertexCount * sizeof(MyVertex));
 		batch->nVertices = inVertexCount;
 		for (int i = 0; i < inVertexCount; i++) {
 			MyVertex *v = &batch->vertices[i];
@@ -287,7 +292,7 @@ public:
 			v->b = inVertices[i].mColor.b;
 			v->a = inVertices[i].mColor.a;
 		}
-		batch->indices = (uint32_t *)globalAlloc(inIndexCount * sizeof(uint32_t));
+		batch->indices = (uint32_t *)globalAllocUninit(inIndexCount * sizeof(uint32_t));
 		batch->nIndices = inIndexCount;
 		for (int i = 0; i < inIndexCount; i++) {
 			batch->indices[i] = inIndices[i];
@@ -363,8 +368,11 @@ void joltUpdate(void) {
 
 	const int cCollisionSteps = 1;
 	// Step the world
-	physicsSystem->OptimizeBroadPhase();
-	physicsSystem->Update(PHYS_DELTATIME, cCollisionSteps, tempAllocator, jobSystem);
+	{
+		PROF_SCOPE("joltStep");
+		physicsSystem->OptimizeBroadPhase();
+		physicsSystem->Update(PHYS_DELTATIME, cCollisionSteps, tempAllocator, jobSystem);
+	}
 
 	joltBodyUpdatePost(bi);
 	joltCharacterUpdatePost(bi);
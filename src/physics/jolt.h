@@ -77,6 +77,9 @@ static inline Transform *getTf(entity_t entity) {
 	//return static_cast<Transform *>(getComponent(TRANSFORM, entity));
 	return &TRANSFORMS[entity];
 }
+static inline Transform *getTfMut(entity_t entity) {
+	return &TRANSFORMS.mut(entity);
+}
 static inline JPH::BodyID getJBody(PhysBody *pb) {
 	return JPH::BodyID{ pb->joltBody };
 }
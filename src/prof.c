@@ -0,0 +1,227 @@
+#include <prof.h>
+#include "system_init.h"
+#include "system_events.h"
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <string.h>
+#include <main.h>
+#include <mem.h>
+#include <jobs.h>
+#include <assets.h>
+
+struct ProfEvent {
+	const char *name;
+	const void *fn;
+	uint64_t start;
+	uint64_t end;
+	char detail[PROF_DETAIL_LEN];
+};
+
+/*
+ * Only the owning thread writes a ring. head counts the scopes ever written, the dump copies
+ * the last PROF_RING_SIZE of them and drops the ones that were overwritten while it copied.
+ */
+struct ProfRing {
+	SDL_atomic_t head;
+	unsigned int depth;
+	char threadName[16];
+	struct ProfEvent open[PROF_MAX_DEPTH];
+	struct ProfEvent events[PROF_RING_SIZE];
+};
+
+bool profRecording;
+
+static bool startRequest;
+static const char *stopRequest;
+static SDL_threadID mainThread;
+static uint64_t profStartTime;
+
+static struct ProfRing *rings[PROF_MAX_THREADS];
+static SDL_atomic_t nRings;
+static THREAD_LOCAL struct ProfRing *threadRing;
+static THREAD_LOCAL bool threadNoRing;
+
+static struct ProfRing *profNewRing(void) {
+	int idx = SDL_AtomicAdd(&nRings, 1);
+	if (idx >= PROF_MAX_THREADS) {
+		threadNoRing = true;
+		return NULL;
+	}
+	struct ProfRing *r = globalAlloc(sizeof(*r));
+	if (SDL_ThreadID() == mainThread) {
+		snprintf(r->threadName, sizeof(r->threadName), "main");
+	} else if (jobsThreadIndex()) {
+		snprintf(r->threadName, sizeof(r->threadName), "worker %d", jobsThreadIndex());
+	} else {
+		snprintf(r->threadName, sizeof(r->threadName), "thread %d", idx);
+	}
+	SDL_AtomicSetPtr((void **)&rings[idx], r);
+	threadRing = r;
+	return r;
+}
+
+void profBegin(const char *name, const void *fn, const char *detail) {
+	struct ProfRing *r = threadRing;
+	if (!r) {
+		if (threadNoRing || !(r = profNewRing()))
+			return;
+	}
+	/* Scopes nested too deep are counted so their ends match, but not recorded */
+	if (r->depth++ >= PROF_MAX_DEPTH)
+		return;
+	struct ProfEvent *ev = &r->open[r->depth - 1];
+	ev->name = name;
+	ev->fn = fn;
+	if (detail) {
+		strncpy(ev->detail, detail, PROF_DETAIL_LEN - 1);
+		ev->detail[PROF_DETAIL_LEN - 1] = 0;
+	} else {
+		ev->detail[0] = 0;
+	}
+	ev->start = SDL_GetPerformanceCounter();
+}
+
+void profEnd(void) {
+	uint64_t end = SDL_GetPerformanceCounter();
+	struct ProfRing *r = threadRing;
+	/* Recording may have started inside the scope */
+	if (!r || !r->depth)
+		return;
+	if (--r->depth >= PROF_MAX_DEPTH)
+		return;
+	unsigned int head = SDL_AtomicGet(&r->head);
+	struct ProfEvent *ev = &r->events[head & (PROF_RING_SIZE - 1)];
+	*ev = r->open[r->depth];
+	ev->end = end;
+	SDL_AtomicSet(&r->head, head + 1);
+}
+
+void profInit(void) {
+	mainThread = SDL_ThreadID();
+}
+
+void profFini(void) {
+	for (int i = 0; i < PROF_MAX_THREADS; i++) {
+		if (rings[i])
+			globalDealloc(rings[i]);
+		rings[i] = NULL;
+	}
+	SDL_AtomicSet(&nRings, 0);
+	profRecording = false;
+}
+
+void profStart(void) {
+	startRequest = true;
+	stopRequest = NULL;
+}
+
+void profStop(const char *file) {
+	startRequest = false;
+	stopRequest = file;
+}
+
+void profFrame(void) {
+	/* Only switch between frames, where the main thread has no open scopes and no jobs run */
+	if (startRequest && !profRecording) {
+		for (int i = 0; i < PROF_MAX_THREADS; i++) {
+			struct ProfRing *r = SDL_AtomicGetPtr((void **)&rings[i]);
+			if (r) {
+				SDL_AtomicSet(&r->head, 0);
+				r->depth = 0;
+			}
+		}
+		profStartTime = SDL_GetPerformanceCounter();
+		profRecording = true;
+		logNorm("Profiler: recording\n");
+	}
+	if (stopRequest && profRecording) {
+		profRecording = false;
+		profDump(stopRequest);
+	}
+	startRequest = false;
+	stopRequest = NULL;
+}
+
+static void profWrite(struct Asset *a, const char *s) {
+	assetUserWrite(a, s, strlen(s));
+}
+
+static void profWriteEscaped(struct Asset *a, const char *s) {
+	char buf[2 * PROF_DETAIL_LEN + 8];
+	size_t n = 0;
+	for (; *s; s++) {
+		if (n + 7 > sizeof(buf)) {
+			assetUserWrite(a, buf, n);
+			n = 0;
+		}
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\') {
+			buf[n++] = '\\';
+			buf[n++] = c;
+		} else if (c < 0x20) {
+			n += snprintf(&buf[n], 7, "\\u%04x", c);
+		} else {
+			buf[n++] = c;
+		}
+	}
+	assetUserWrite(a, buf, n);
+}
+
+void profDump(const char *file) {
+	struct Asset *a = assetUserOpen(file, true);
+	if (!a) {
+		logNorm("Profiler: cannot write %s\n", file);
+		return;
+	}
+
+	double usPerTick = 1e6 / SDL_GetPerformanceFrequency();
+	struct ProfEvent *copy = globalAllocUninit(PROF_RING_SIZE * sizeof(struct ProfEvent));
+	unsigned int total = 0;
+	char line[256];
+	bool first = true;
+	profWrite(a, "{\"traceEvents\":[\n");
+
+	int n = SDL_AtomicGet(&nRings);
+	for (int i = 0; i < n && i < PROF_MAX_THREADS; i++) {
+		struct ProfRing *r = SDL_AtomicGetPtr((void **)&rings[i]);
+		if (!r)
+			continue;
+		int len = snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+			first ? "" : ",\n", i, r->threadName);
+		assetUserWrite(a, line, len);
+		first = false;
+
+		unsigned int head = SDL_AtomicGet(&r->head);
+		unsigned int begin = head > PROF_RING_SIZE ? head - PROF_RING_SIZE : 0;
+		for (unsigned int e = begin; e < head; e++) {
+			copy[e - begin] = r->events[e & (PROF_RING_SIZE - 1)];
+		}
+		/* Scopes the thread wrote while copying replaced the oldest ones */
+		unsigned int newHead = SDL_AtomicGet(&r->head);
+		unsigned int valid = newHead > PROF_RING_SIZE ? newHead - PROF_RING_SIZE : 0;
+		for (unsigned int e = begin > valid ? begin : valid; e < head; e++) {
+			struct ProfEvent *ev = &copy[e - begin];
+			double ts = ev->start > profStartTime ? (ev->start - profStartTime) * usPerTick : 0;
+			profWrite(a, ",\n{\"name\":\"");
+			profWriteEscaped(a, ev->name);
+			len = snprintf(line, sizeof(line), "\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", i, ts,
+				(ev->end - ev->start) * usPerTick);
+			assetUserWrite(a, line, len);
+			if (ev->fn) {
+				len = snprintf(line, sizeof(line), ",\"args\":{\"fn\":\"%p\"}", ev->fn);
+				assetUserWrite(a, line, len);
+			} else if (ev->detail[0]) {
+				profWrite(a, ",\"args\":{\"detail\":\"");
+				profWriteEscaped(a, ev->detail);
+				profWrite(a, "\"}");
+			}
+			profWrite(a, "}");
+			total++;
+		}
+	}
+	profWrite(a, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	assetClose(a);
+	globalDealloc(copy);
+	logNorm("Profiler: wrote %u scopes to %s%s\n", total, gameUserDir, file);
+}
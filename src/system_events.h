@@ -26,6 +26,39 @@ void eventStartScene(void);
  */
 void eventEndScene(void);
 
+/**
+ * Frame pacer: sleep until shortly before a deadline in performance counter ticks, then spin.
+ * Returns false without waiting if the deadline has already passed.
+ */
+void pacerInit(void);
+void pacerFini(void);
+bool pacerWait(uint64_t deadline);
+
+/**
+ * Log the pacing statistics of the last second
+ */
+void pacerDumpStats(void);
+
+/**
+ * Log how the update functions of each type are scheduled and the parallelism of the last frame
+ */
+void eventDumpSchedule(void);
+
+/**
+ * Frame time statistics: frameStatsAdd takes the time between the ends of two frames.
+ * The statistics are logged, and written to CSV if frameStatsCsv is set, when the scene ends.
+ */
+void frameStatsInit(uint64_t frameInterval);
+void frameStatsSceneStart(const char *name);
+void frameStatsAdd(uint64_t interval);
+void frameStatsSceneEnd(void);
+void frameStatsDump(void);
+
+/**
+ * Apply profiler start and stop requests, called at the start of every frame
+ */
+void profFrame(void);
+
 void inputInit(void);
 
 void inputFini(void);
@@ -12,4 +12,10 @@ void basicsFini(void);
 
 void ecsInit(void);
 
+void jobsInit(void);
+void jobsFini(void);
+
+void profInit(void);
+void profFini(void);
+
 #endif
@@ -0,0 +1,231 @@
+/*
+ * Object cache benchmark, compares cacheGet/cacheRelease with globalAlloc/globalDealloc.
+ * Output is one CSV line per measurement: name,allocator,threads,ns_per_op
+ * One op is one allocation and its release, averaged over all threads.
+ * small: every thread frees its own objects right away, they never leave its magazine.
+ * local: every thread frees its own objects after holding a few thousand, so magazines refill and drain.
+ * cross: every thread frees the objects its neighbour allocated, like a job handing results
+ * to another, which drains magazines into other threads' pages and empties whole pages.
+ * Thread counts above the number of CPUs are skipped, spinning allocators on shared cores only measure the scheduler.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <mem.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+#include <windows.h>
+static double nowNs(void) {
+	LARGE_INTEGER freq, cnt;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&cnt);
+	return (double)cnt.QuadPart * 1e9 / (double)freq.QuadPart;
+}
+typedef HANDLE BenchThread;
+static DWORD WINAPI benchThreadMain(LPVOID arg);
+static void threadStart(BenchThread *t, void *arg) {
+	*t = CreateThread(NULL, 0, benchThreadMain, arg, 0, NULL);
+}
+static void threadJoin(BenchThread t) {
+	WaitForSingleObject(t, INFINITE);
+	CloseHandle(t);
+}
+static unsigned int cpuCount(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+}
+#define atomicInc(p) _InterlockedIncrement(p)
+#define atomicGet(p) _InterlockedOr(p, 0)
+#else
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+static double nowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+typedef pthread_t BenchThread;
+static void *benchThreadMain(void *arg);
+static void threadStart(BenchThread *t, void *arg) {
+	pthread_create(t, NULL, benchThreadMain, arg);
+}
+static void threadJoin(BenchThread t) {
+	pthread_join(t, NULL);
+}
+static unsigned int cpuCount(void) {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unsigned int)n : 1;
+}
+#define atomicInc(p) __atomic_add_fetch((p), 1, __ATOMIC_ACQ_REL)
+#define atomicGet(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#endif
+
+/* The engine normally gets these from assets.c */
+void logNorm(const char *fmt, ...) {
+	(void)fmt;
+}
+void fail(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	exit(1);
+}
+
+#define BENCH_MAX_THREADS 8
+#define BENCH_OBJ_SIZE 96 /* About a small component or a script local block */
+#define BENCH_BATCH 4096 /* Objects a thread holds at once, several pages worth across threads */
+#define BENCH_SMALL_BATCH 8 /* Fits in half a magazine */
+
+/* Aim for about this many operations per thread and measurement */
+#define BENCH_OPS 1000000
+
+static const unsigned int threadCounts[] = { 1, 2, 4, 8 };
+
+enum BenchAlloc {
+	BENCH_CACHE,
+	BENCH_GLOBAL
+};
+
+struct BenchWorker {
+	unsigned int idx;
+	double ns;
+	BenchThread thread;
+};
+
+static struct Cache cache;
+static enum BenchAlloc allocator;
+static bool cross;
+static unsigned int nThreads;
+static unsigned int batch;
+static unsigned int reps;
+static void **batches[BENCH_MAX_THREADS];
+static volatile long barrierCount;
+
+/* Spin until every thread reached its nth barrier */
+static void barrier(unsigned int n) {
+	atomicInc(&barrierCount);
+	while (atomicGet(&barrierCount) < (long)(n * nThreads)) {
+	}
+}
+
+static void *benchGet(void) {
+	void *p = allocator == BENCH_CACHE ? cacheGet(&cache) : globalAllocUninit(BENCH_OBJ_SIZE);
+	/* Touch the object like a user would */
+	memset(p, 0xAB, 16);
+	return p;
+}
+
+static void benchRelease(void *p) {
+	if (allocator == BENCH_CACHE) {
+		cacheRelease(&cache, p);
+	} else {
+		globalDealloc(p);
+	}
+}
+
+static void benchRun(struct BenchWorker *w) {
+	void **own = batches[w->idx];
+	void **other = batches[cross ? (w->idx + 1) % nThreads : w->idx];
+	unsigned int b = 0;
+	double ns = 0;
+	for (unsigned int r = 0; r < reps; r++) {
+		double t = nowNs();
+		for (unsigned int i = 0; i < batch; i++) {
+			own[i] = benchGet();
+		}
+		ns += nowNs() - t;
+		/* Wait until the neighbour's batch is complete before freeing it */
+		if (cross)
+			barrier(++b);
+		t = nowNs();
+		for (unsigned int i = batch; i-- > 0;) {
+			benchRelease(other[i]);
+		}
+		ns += nowNs() - t;
+		if (cross)
+			barrier(++b);
+	}
+	w->ns = ns;
+	memThreadFini();
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+static DWORD WINAPI benchThreadMain(LPVOID arg) {
+	benchRun(arg);
+	return 0;
+}
+#else
+static void *benchThreadMain(void *arg) {
+	benchRun(arg);
+	return NULL;
+}
+#endif
+
+static void benchCase(const char *name, enum BenchAlloc alloc, bool crossThread, unsigned int batchSize, unsigned int n) {
+	struct BenchWorker workers[BENCH_MAX_THREADS];
+	allocator = alloc;
+	cross = crossThread;
+	batch = batchSize;
+	nThreads = n;
+	reps = BENCH_OPS / batch;
+	barrierCount = 0;
+
+	for (unsigned int i = 0; i < n; i++) {
+		workers[i].idx = i;
+		threadStart(&workers[i].thread, &workers[i]);
+	}
+	double ns = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		threadJoin(workers[i].thread);
+		ns += workers[i].ns;
+	}
+	unsigned long ops = (unsigned long)reps * batch * n;
+	printf("%s,%s,%u,%.2f\n", name, alloc == BENCH_CACHE ? "cache" : "global", n, ns / (double)ops);
+
+	if (alloc == BENCH_CACHE) {
+		/* Every thread returned its magazine, so only the spare pages may be left */
+		struct CacheStats st;
+		cacheGetStats(&cache, &st);
+		if (st.live || st.emptyPages != st.pages || st.pages > cache.maxEmptyPages) {
+			fail("Cache leaked: %lu live objects, %u pages, %u empty\n", (unsigned long)st.live, st.pages, st.emptyPages);
+		}
+		fprintf(stderr, "%s %u threads: %lu pages freed so far\n", name, n, (unsigned long)st.pagesFreed);
+	}
+}
+
+int main(void) {
+	memInit();
+	cacheCreate(&cache, BENCH_OBJ_SIZE, "bench");
+	for (unsigned int i = 0; i < BENCH_MAX_THREADS; i++) {
+		batches[i] = malloc(BENCH_BATCH * sizeof(void *));
+	}
+
+	unsigned int cpus = cpuCount();
+	printf("name,allocator,threads,ns_per_op\n");
+	for (unsigned int i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); i++) {
+		unsigned int n = threadCounts[i];
+		if (n > cpus)
+			break;
+		benchCase("small", BENCH_CACHE, false, BENCH_SMALL_BATCH, n);
+		benchCase("small", BENCH_GLOBAL, false, BENCH_SMALL_BATCH, n);
+		benchCase("local", BENCH_CACHE, false, BENCH_BATCH, n);
+		benchCase("local", BENCH_GLOBAL, false, BENCH_BATCH, n);
+		/* One thread would free its own batch */
+		if (n > 1) {
+			benchCase("cross", BENCH_CACHE, true, BENCH_BATCH, n);
+			benchCase("cross", BENCH_GLOBAL, true, BENCH_BATCH, n);
+		}
+	}
+
+	cacheDestroy(&cache);
+	for (unsigned int i = 0; i < BENCH_MAX_THREADS; i++) {
+		free(batches[i]);
+	}
+	return 0;
+}
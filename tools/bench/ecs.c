@@ -0,0 +1,506 @@
+/*
+ * Headless ECS benchmark, links only the ECS and memory allocators.
+ * Output is one CSV line per measurement: name,entities,component_size,ns_per_op
+ * Every operation is reported per entity, except purge which is per scene.
+ * integrate_aos and integrate_soa move positions by velocities, in a plain list and a structure-of-arrays list.
+ * Snapshot and structure-of-arrays corner cases are checked once before the measurements, a failed check exits with an error.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <ecs.h>
+#include <vec.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include "../../src/system_init.h"
+
+#if defined(_WIN32) || defined(_WIN64)
+static double nowNs(void) {
+	LARGE_INTEGER freq, cnt;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&cnt);
+	return (double)cnt.QuadPart * 1e9 / (double)freq.QuadPart;
+}
+#else
+#include <time.h>
+static double nowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+#endif
+
+/* The engine normally gets these from assets.c */
+void logNorm(const char *fmt, ...) {
+	(void)fmt;
+}
+void fail(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	exit(1);
+}
+
+#define BENCH_CL_A 0 /* Every entity */
+#define BENCH_CL_B 1 /* Every 2nd entity */
+#define BENCH_CL_C 2 /* Every 4th entity */
+#define BENCH_CL_NOTIFY 3 /* Same as A, but with a notifier */
+#define BENCH_CL_EXCLUDED 4 /* Left out of snapshots, only used by the checks */
+#define BENCH_CL_SOA 5 /* Structure-of-arrays list */
+#define BENCH_CL_AOS 6 /* Same data as a plain list */
+
+/* Aim for about this many operations per measurement, small entity counts are repeated */
+#define BENCH_OPS 2000000
+
+static const unsigned int componentSizes[] = { 8, 32, 128 };
+
+static entity_t *entities;
+static entity_t *shuffled;
+static entity_t *misses; /* Shuffled entities that are not in BENCH_CL_C */
+static unsigned int nMisses;
+
+static uint32_t randState = 0x12345678;
+static uint32_t randNext(void) {
+	randState ^= randState << 13;
+	randState ^= randState >> 17;
+	randState ^= randState << 5;
+	return randState;
+}
+
+static void report(const char *name, unsigned int n, unsigned int size, double nsPerOp) {
+	printf("%s,%u,%u,%.2f\n", name, n, size, nsPerOp);
+}
+
+static volatile uint32_t sink;
+static void benchNotifier(void *arg, void *component, int type) {
+	(void)arg;
+	if (type == NOTIFY_CREATE)
+		((float *)component)[1] = 1.0f;
+	else if (type == NOTIFY_DELETE)
+		sink += *(entity_t *)component;
+}
+
+static void initLists(unsigned int size) {
+	for (int id = BENCH_CL_A; id <= BENCH_CL_NOTIFY; id++) {
+		componentListInitSz(id, size);
+	}
+	setNotifier(BENCH_CL_NOTIFY, benchNotifier, NULL);
+}
+
+static void finiLists(void) {
+	for (int id = BENCH_CL_A; id <= BENCH_CL_NOTIFY; id++) {
+		componentListFini(id);
+	}
+}
+
+static void populate(unsigned int n) {
+	for (unsigned int i = 0; i < n; i++) {
+		entities[i] = newEntity();
+		newComponent(BENCH_CL_A, entities[i]);
+		if (i % 2 == 0)
+			newComponent(BENCH_CL_B, entities[i]);
+		if (i % 4 == 0)
+			newComponent(BENCH_CL_C, entities[i]);
+	}
+}
+
+static void shuffle(unsigned int n) {
+	for (unsigned int i = 0; i < n; i++) {
+		shuffled[i] = entities[i];
+	}
+	for (unsigned int i = 1; i < n; i++) {
+		unsigned int j = randNext() % (i + 1);
+		entity_t t = shuffled[i];
+		shuffled[i] = shuffled[j];
+		shuffled[j] = t;
+	}
+	nMisses = 0;
+	for (unsigned int i = 0; i < n; i++) {
+		if (!getComponentOpt(BENCH_CL_C, shuffled[i]))
+			misses[nMisses++] = shuffled[i];
+	}
+}
+
+enum BenchOp {
+	OP_NEW_ENTITY,
+	OP_NEW_COMPONENT,
+	OP_NEW_COMPONENT_NOTIFY,
+	OP_NEW_COMPONENTS_BULK,
+	OP_GET_HIT,
+	OP_GET_MISS,
+	OP_ITERATE,
+	OP_VIEW_ITERATE,
+	OP_SNAPSHOT,
+	OP_RESTORE,
+	OP_REMOVE_COMPONENT,
+	OP_REMOVE_COMPONENT_NOTIFY,
+	OP_REMOVE_COMPONENTS_BULK,
+	OP_PURGE,
+	N_OPS
+};
+static const char *opNames[N_OPS] = {
+	"new_entity",
+	"new_component",
+	"new_component_notify",
+	"new_components_bulk",
+	"get_component_hit",
+	"get_component_miss",
+	"iterate",
+	"view_iterate",
+	"snapshot",
+	"restore",
+	"remove_component",
+	"remove_component_notify",
+	"remove_components_bulk",
+	"purge"
+};
+
+static void benchRound(unsigned int n, double *total) {
+	double t;
+	uint32_t sum = 0;
+
+	t = nowNs();
+	for (unsigned int i = 0; i < n; i++) {
+		entities[i] = newEntity();
+	}
+	total[OP_NEW_ENTITY] += nowNs() - t;
+
+	t = nowNs();
+	for (unsigned int i = 0; i < n; i++) {
+		newComponent(BENCH_CL_A, entities[i]);
+	}
+	total[OP_NEW_COMPONENT] += nowNs() - t;
+
+	t = nowNs();
+	for (unsigned int i = 0; i < n; i++) {
+		newComponent(BENCH_CL_NOTIFY, entities[i]);
+	}
+	total[OP_NEW_COMPONENT_NOTIFY] += nowNs() - t;
+
+	t = nowNs();
+	newComponents(BENCH_CL_B, n, entities);
+	total[OP_NEW_COMPONENTS_BULK] += nowNs() - t;
+
+	for (unsigned int i = 0; i < n; i += 4) {
+		newComponent(BENCH_CL_C, entities[i]);
+	}
+	shuffle(n);
+
+	t = nowNs();
+	for (unsigned int i = 0; i < n; i++) {
+		sum += *(entity_t *)getComponent(BENCH_CL_A, shuffled[i]);
+	}
+	total[OP_GET_HIT] += nowNs() - t;
+
+	t = nowNs();
+	for (unsigned int i = 0; i < nMisses; i++) {
+		sum += getComponentOpt(BENCH_CL_C, misses[i]) != NULL;
+	}
+	/* Scaled to n lookups so all ops share the same divisor */
+	total[OP_GET_MISS] += nMisses ? (nowNs() - t) * n / nMisses : 0;
+
+	t = nowNs();
+	for (entity_t *c = clBegin(BENCH_CL_A); c; c = clNext(BENCH_CL_A, c)) {
+		sum += *c;
+	}
+	total[OP_ITERATE] += nowNs() - t;
+
+	const int viewIds[2] = { BENCH_CL_A, BENCH_CL_C };
+	struct ComponentView view;
+	t = nowNs();
+	clViewInit(&view, 2, viewIds);
+	while (clViewNext(&view)) {
+		sum += *(entity_t *)view.c[0];
+	}
+	total[OP_VIEW_ITERATE] += nowNs() - t;
+
+	t = nowNs();
+	struct EcsSnapshot *snap = ecsSnapshot();
+	total[OP_SNAPSHOT] += nowNs() - t;
+	t = nowNs();
+	ecsRestore(snap);
+	total[OP_RESTORE] += nowNs() - t;
+	ecsSnapshotFree(snap);
+
+	t = nowNs();
+	for (unsigned int i = 0; i < n; i++) {
+		removeComponent(BENCH_CL_A, shuffled[i]);
+	}
+	total[OP_REMOVE_COMPONENT] += nowNs() - t;
+
+	t = nowNs();
+	for (unsigned int i = 0; i < n; i++) {
+		removeComponent(BENCH_CL_NOTIFY, shuffled[i]);
+	}
+	total[OP_REMOVE_COMPONENT_NOTIFY] += nowNs() - t;
+
+	t = nowNs();
+	removeComponents(BENCH_CL_B, n, shuffled);
+	total[OP_REMOVE_COMPONENTS_BULK] += nowNs() - t;
+
+	componentListEndScene();
+	populate(n);
+	t = nowNs();
+	componentListEndScene();
+	total[OP_PURGE] += nowNs() - t;
+
+	sink += sum;
+}
+
+static unsigned int excludedDeletes;
+static void excludedNotifier(void *arg, void *component, int type) {
+	(void)arg;
+	(void)component;
+	if (type == NOTIFY_DELETE)
+		excludedDeletes++;
+}
+
+/* Entities created after a snapshot lose their components in left-out lists on restore, their IDs are handed out again */
+static void checkSnapshotExcluded(void) {
+	initLists(32);
+	componentListInitSz(BENCH_CL_EXCLUDED, 32);
+	componentListAllowSnapshot(BENCH_CL_EXCLUDED, false);
+	setNotifier(BENCH_CL_EXCLUDED, excludedNotifier, NULL);
+	populate(100);
+	newComponent(BENCH_CL_EXCLUDED, entities[0]);
+
+	struct EcsSnapshot *snap = ecsSnapshot();
+	entity_t late = newEntity();
+	newComponent(BENCH_CL_A, late);
+	newComponent(BENCH_CL_EXCLUDED, late);
+	excludedDeletes = 0;
+	ecsRestore(snap);
+	ecsSnapshotFree(snap);
+
+	entity_t reused = newEntity();
+	if (excludedDeletes != 1 || getComponentOpt(BENCH_CL_EXCLUDED, reused) || getComponentOpt(BENCH_CL_A, reused)) {
+		fail("Restore left the components of 0x%x on the new entity 0x%x\n", late, reused);
+	}
+	if (!getComponentOpt(BENCH_CL_EXCLUDED, entities[0]) || clCount(BENCH_CL_EXCLUDED) != 1) {
+		fail("Restore removed a component of an entity that existed in the snapshot\n");
+	}
+
+	componentListEndScene();
+	componentListFini(BENCH_CL_EXCLUDED);
+	finiLists();
+}
+
+/* Fields of the structure-of-arrays check list, derived from the entity so they can be verified after moves */
+enum { SOA_X, SOA_Y, SOA_TAG, SOA_N_FIELDS };
+static const unsigned int soaCheckFields[SOA_N_FIELDS] = { sizeof(float), sizeof(float), sizeof(entity_t) };
+
+static void soaSet(entity_t en) {
+	void *c = getComponent(BENCH_CL_SOA, en);
+	*(float *)clField(BENCH_CL_SOA, c, SOA_X) = (float)(en >> ENTITY_ID_SHIFT);
+	*(float *)clField(BENCH_CL_SOA, c, SOA_Y) = (float)(en >> ENTITY_ID_SHIFT) * -0.5f;
+	*(entity_t *)clField(BENCH_CL_SOA, c, SOA_TAG) = en;
+}
+
+static void soaVerify(const char *step, unsigned int expect) {
+	idx_t count = clCount(BENCH_CL_SOA);
+	unsigned int live = 0;
+	for (unsigned int page = 0; page * 1024 < count; page++) {
+		idx_t n;
+		float *x = clFieldPage(BENCH_CL_SOA, page, SOA_X, &n);
+		float *y = clFieldPage(BENCH_CL_SOA, page, SOA_Y, &n);
+		entity_t *tag = clFieldPage(BENCH_CL_SOA, page, SOA_TAG, &n);
+		if (((uintptr_t)x | (uintptr_t)y | (uintptr_t)tag) & 15) {
+			fail("SoA %s: field array of page %u is not aligned\n", step, page);
+		}
+		for (idx_t i = 0; i < n; i++) {
+			entity_t en = *(entity_t *)clAt(BENCH_CL_SOA, page * 1024 + i);
+			if (!en)
+				continue;
+			live++;
+			if (getComponent(BENCH_CL_SOA, en) != clAt(BENCH_CL_SOA, page * 1024 + i) || tag[i] != en ||
+					x[i] != (float)(en >> ENTITY_ID_SHIFT) || y[i] != (float)(en >> ENTITY_ID_SHIFT) * -0.5f) {
+				fail("SoA %s: fields of 0x%x did not move with it\n", step, en);
+			}
+		}
+	}
+	if (live != expect) {
+		fail("SoA %s: %u components, expected %u\n", step, live, expect);
+	}
+}
+
+static int soaCompareDesc(const void *a, const void *b) {
+	entity_t ea = *(const entity_t *)a, eb = *(const entity_t *)b;
+	return ea < eb ? 1 : ea > eb ? -1 : 0;
+}
+
+/* Field arrays have to follow their entity through every operation that moves dense slots */
+static void checkSoA(void) {
+	const unsigned int n = 3000;
+	initLists(32);
+	componentListInitSoA(BENCH_CL_SOA, SOA_N_FIELDS, soaCheckFields);
+	populate(n);
+	newComponents(BENCH_CL_SOA, n, entities);
+	for (unsigned int i = 0; i < n; i++) {
+		soaSet(entities[i]);
+	}
+	soaVerify("create", n);
+
+	/* Swap-remove one by one and in bulk */
+	unsigned int live = n;
+	for (unsigned int i = 0; i < n; i += 7) {
+		removeComponent(BENCH_CL_SOA, entities[i]);
+		live--;
+	}
+	soaVerify("remove", live);
+	entity_t *bulk = malloc(sizeof(entity_t) * n);
+	unsigned int nBulk = 0;
+	for (unsigned int i = 3; i < n; i += 7) {
+		bulk[nBulk++] = entities[i];
+	}
+	removeComponents(BENCH_CL_SOA, nBulk, bulk);
+	live -= nBulk;
+	soaVerify("bulk remove", live);
+
+	componentListSort(BENCH_CL_SOA, soaCompareDesc);
+	soaVerify("sort", live);
+	componentListGroup(BENCH_CL_SOA, BENCH_CL_C);
+	soaVerify("group", live);
+
+	struct EcsSnapshot *snap = ecsSnapshot();
+	for (unsigned int i = 1; i < n; i += 7) {
+		removeComponent(BENCH_CL_SOA, entities[i]);
+	}
+	for (idx_t i = 0; i < clCount(BENCH_CL_SOA); i++) {
+		void *c = clAt(BENCH_CL_SOA, i);
+		if (*(entity_t *)c)
+			*(float *)clField(BENCH_CL_SOA, c, SOA_X) = -1;
+	}
+	ecsRestore(snap);
+	ecsSnapshotFree(snap);
+	soaVerify("restore", live);
+
+	free(bulk);
+	componentListEndScene();
+	componentListFini(BENCH_CL_SOA);
+	finiLists();
+}
+
+struct BenchBody {
+	entity_t en;
+	float pos[3];
+	float vel[3];
+};
+enum { SOA_POS_X, SOA_POS_Y, SOA_POS_Z, SOA_VEL_X, SOA_VEL_Y, SOA_VEL_Z, SOA_BODY_FIELDS };
+
+/* pos += vel * dt over every component, the loop a position-only system runs */
+static void benchIntegrate(unsigned int n) {
+	static const unsigned int bodyFields[SOA_BODY_FIELDS] = {
+		sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float), sizeof(float)
+	};
+	const float dt = 1.0f / 60;
+	unsigned int reps = BENCH_OPS / n;
+	if (reps < 1)
+		reps = 1;
+
+	componentListInit(BENCH_CL_AOS, struct BenchBody);
+	componentListInitSoA(BENCH_CL_SOA, SOA_BODY_FIELDS, bodyFields);
+	newEntities(n, entities);
+	newComponents(BENCH_CL_AOS, n, entities);
+	newComponents(BENCH_CL_SOA, n, entities);
+	for (unsigned int i = 0; i < n; i++) {
+		struct BenchBody *b = getComponent(BENCH_CL_AOS, entities[i]);
+		void *c = getComponent(BENCH_CL_SOA, entities[i]);
+		for (int f = 0; f < 3; f++) {
+			b->vel[f] = (float)(randNext() % 100);
+			*(float *)clField(BENCH_CL_SOA, c, SOA_VEL_X + f) = b->vel[f];
+		}
+	}
+
+	double t = nowNs();
+	for (unsigned int r = 0; r < reps; r++) {
+		for (struct BenchBody *b = clBegin(BENCH_CL_AOS); b; b = clNext(BENCH_CL_AOS, b)) {
+			b->pos[0] += b->vel[0] * dt;
+			b->pos[1] += b->vel[1] * dt;
+			b->pos[2] += b->vel[2] * dt;
+		}
+	}
+	report("integrate_aos", n, sizeof(struct BenchBody), (nowNs() - t) / ((double)reps * n));
+
+	t = nowNs();
+	for (unsigned int r = 0; r < reps; r++) {
+		idx_t cnt;
+		for (unsigned int page = 0; clFieldPage(BENCH_CL_SOA, page, 0, &cnt); page++) {
+			for (int f = 0; f < 3; f++) {
+				float *pos = clFieldPage(BENCH_CL_SOA, page, SOA_POS_X + f, &cnt);
+				float *vel = clFieldPage(BENCH_CL_SOA, page, SOA_VEL_X + f, &cnt);
+				vecArrayMulAddS(pos, vel, dt, cnt);
+			}
+		}
+	}
+	report("integrate_soa", n, sizeof(struct BenchBody), (nowNs() - t) / ((double)reps * n));
+
+	/* Both layouts must end up with the same positions */
+	for (unsigned int i = 0; i < n; i += 97) {
+		struct BenchBody *b = getComponent(BENCH_CL_AOS, entities[i]);
+		float x = *(float *)clField(BENCH_CL_SOA, getComponent(BENCH_CL_SOA, entities[i]), SOA_POS_X);
+		if (x != b->pos[0]) {
+			fail("integrate_soa: position of 0x%x is %f, expected %f\n", entities[i], x, b->pos[0]);
+		}
+	}
+
+	componentListEndScene();
+	componentListFini(BENCH_CL_SOA);
+	componentListFini(BENCH_CL_AOS);
+}
+
+static void benchSize(unsigned int n, unsigned int size) {
+	double total[N_OPS] = { 0 };
+	unsigned int reps = n ? BENCH_OPS / n : 1;
+	if (reps < 1)
+		reps = 1;
+
+	initLists(size);
+	for (unsigned int r = 0; r < reps; r++) {
+		benchRound(n, total);
+	}
+	finiLists();
+
+	for (int op = 0; op < N_OPS; op++) {
+		if (!n && op != OP_PURGE)
+			continue;
+		/* Purge is measured per scene, the rest per entity */
+		double perOp = op == OP_PURGE ? total[op] / reps : total[op] / ((double)reps * n);
+		if (op == OP_VIEW_ITERATE)
+			perOp *= 4; /* Only every 4th entity matches */
+		report(opNames[op], n, size, perOp);
+	}
+}
+
+int main(void) {
+	static const unsigned int counts[] = { 0, 1000, 100000, 1000000 };
+
+	memInit();
+	ecsInit();
+	entities = malloc(sizeof(entity_t) * MAX_ENTITY);
+	shuffled = malloc(sizeof(entity_t) * MAX_ENTITY);
+	misses = malloc(sizeof(entity_t) * MAX_ENTITY);
+
+	/* Warm up the allocator */
+	initLists(32);
+	populate(1000);
+	componentListEndScene();
+	finiLists();
+
+	checkSnapshotExcluded();
+	checkSoA();
+
+	printf("name,entities,component_size,ns_per_op\n");
+	for (unsigned int c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+		for (unsigned int s = 0; s < sizeof(componentSizes) / sizeof(componentSizes[0]); s++) {
+			benchSize(counts[c], componentSizes[s]);
+		}
+		if (counts[c])
+			benchIntegrate(counts[c]);
+	}
+
+	free(misses);
+	free(shuffled);
+	free(entities);
+	return 0;
+}
@@ -0,0 +1,244 @@
+/*
+ * Hash map benchmark, compares the old chained HashTable with HashMap.
+ * Output is one CSV line per measurement: name,table,keys,ns_per_op
+ * The old table gets 128 buckets, the count draw.cpp used for models.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include <mem.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+static double nowNs(void) {
+	LARGE_INTEGER freq, cnt;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&cnt);
+	return (double)cnt.QuadPart * 1e9 / (double)freq.QuadPart;
+}
+#else
+#include <time.h>
+static double nowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+#endif
+
+/* The engine normally gets these from assets.c */
+void logNorm(const char *fmt, ...) {
+	(void)fmt;
+}
+void fail(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	exit(1);
+}
+
+#define BENCH_KEY_LEN 32 /* MODEL_NAME_LEN */
+#define BENCH_HT_BUCKETS 128
+
+/* Aim for about this many operations per measurement, small key sets are repeated */
+#define BENCH_OPS 2000000
+
+static const unsigned int keyCounts[] = { 64, 1024, 16384 };
+
+struct BenchEntry {
+	struct HTEntry en;
+	char name[BENCH_KEY_LEN];
+};
+
+static uint32_t randState = 0x12345678;
+static uint32_t randNext(void) {
+	randState ^= randState << 13;
+	randState ^= randState >> 17;
+	randState ^= randState << 5;
+	return randState;
+}
+
+static void shuffle(char (*keys)[BENCH_KEY_LEN], unsigned int n) {
+	char tmp[BENCH_KEY_LEN];
+	for (unsigned int i = n - 1; i > 0; i--) {
+		unsigned int j = randNext() % (i + 1);
+		memcpy(tmp, keys[i], BENCH_KEY_LEN);
+		memcpy(keys[i], keys[j], BENCH_KEY_LEN);
+		memcpy(keys[j], tmp, BENCH_KEY_LEN);
+	}
+}
+
+/* Names like the ones in model files: a few prefixes and numbered parts, salt 1 gives LODs that never occur with salt 0 */
+static void makeModelKeys(char (*keys)[BENCH_KEY_LEN], unsigned int n, unsigned int salt) {
+	static const char *prefixes[] = {
+		"stage1_tree", "stage1_rock", "stage2_pillar", "enemy_fairy", "enemy_spirit",
+		"boss_wing", "bullet_rice", "bullet_orb", "player_option", "bg_cloud"
+	};
+	for (unsigned int i = 0; i < n; i++) {
+		snprintf(keys[i], BENCH_KEY_LEN, "%s%02u_lod%u", prefixes[i % 10], i / 10, i % 3 + salt * 3);
+	}
+}
+
+/* Permutations of the same characters, every key lands in the same bucket of the old table */
+static void makeAnagramKeys(char (*keys)[BENCH_KEY_LEN], unsigned int n, unsigned int salt) {
+	static const char base[] = "mesh_abcdefghij";
+	for (unsigned int i = 0; i < n; i++) {
+		char pool[10];
+		memcpy(pool, base + 5, 10);
+		memcpy(keys[i], base, sizeof(base));
+		/* Permutation number 2i + salt, decoded as a factorial number */
+		unsigned int v = i * 2 + salt;
+		for (unsigned int c = 0; c < 10; c++) {
+			unsigned int left = 10 - c;
+			unsigned int pick = v % left;
+			v /= left;
+			keys[i][5 + c] = pool[pick];
+			memmove(&pool[pick], &pool[pick + 1], left - pick - 1);
+		}
+	}
+}
+
+static void report(const char *name, const char *table, unsigned int n, double ns, unsigned long ops) {
+	printf("%s,%s,%u,%.2f\n", name, table, n, ns / (double)ops);
+}
+
+static unsigned int checksum;
+
+static void benchSet(const char *setName, void (*make)(char (*)[BENCH_KEY_LEN], unsigned int, unsigned int), unsigned int n) {
+	char (*keys)[BENCH_KEY_LEN] = malloc(n * BENCH_KEY_LEN);
+	char (*lookups)[BENCH_KEY_LEN] = malloc(n * BENCH_KEY_LEN);
+	char (*misses)[BENCH_KEY_LEN] = malloc(n * BENCH_KEY_LEN);
+	struct BenchEntry *entries = malloc(n * sizeof(*entries));
+	make(keys, n, 0);
+	make(misses, n, 1);
+	memcpy(lookups, keys, n * BENCH_KEY_LEN);
+	shuffle(lookups, n);
+	shuffle(misses, n);
+
+	unsigned int reps = BENCH_OPS / n;
+	if (!reps) {
+		reps = 1;
+	}
+	unsigned long ops = (unsigned long)reps * n;
+	char name[64];
+
+	/* Old table, long chains make it quadratic so it gets fewer repeats */
+	unsigned int htReps = reps / (n / 64);
+	if (!htReps) {
+		htReps = 1;
+	}
+	unsigned long htOps = (unsigned long)htReps * n;
+	struct HashTable tbl;
+	double insNs = 0;
+	double t;
+	for (unsigned int r = 0; r < htReps; r++) {
+		HTCreate(&tbl, BENCH_HT_BUCKETS);
+		t = nowNs();
+		for (unsigned int i = 0; i < n; i++) {
+			memcpy(entries[i].name, keys[i], BENCH_KEY_LEN);
+			entries[i].en.key = entries[i].name;
+			HTAdd(&tbl, &entries[i].en);
+		}
+		insNs += nowNs() - t;
+		if (r != htReps - 1) {
+			HTDestroy(&tbl);
+		}
+	}
+	snprintf(name, sizeof(name), "%s_insert", setName);
+	report(name, "ht", n, insNs, htOps);
+
+	t = nowNs();
+	for (unsigned int r = 0; r < htReps; r++) {
+		for (unsigned int i = 0; i < n; i++) {
+			checksum += HTGet(&tbl, lookups[i]) != NULL;
+		}
+	}
+	snprintf(name, sizeof(name), "%s_hit", setName);
+	report(name, "ht", n, nowNs() - t, htOps);
+
+	unsigned int htMissHits = 0;
+	t = nowNs();
+	for (unsigned int r = 0; r < htReps; r++) {
+		for (unsigned int i = 0; i < n; i++) {
+			htMissHits += HTGet(&tbl, misses[i]) != NULL;
+		}
+	}
+	snprintf(name, sizeof(name), "%s_miss", setName);
+	report(name, "ht", n, nowNs() - t, htOps);
+	HTDestroy(&tbl);
+
+	/* New map, created at the same size as the old table like draw.cpp does */
+	struct HashMap map;
+	insNs = 0;
+	for (unsigned int r = 0; r < reps; r++) {
+		hashMapCreate(&map, BENCH_HT_BUCKETS);
+		t = nowNs();
+		for (unsigned int i = 0; i < n; i++) {
+			hashMapPut(&map, entries[i].name, &entries[i]);
+		}
+		insNs += nowNs() - t;
+		if (r != reps - 1) {
+			hashMapDestroy(&map);
+		}
+	}
+	snprintf(name, sizeof(name), "%s_insert", setName);
+	report(name, "hashmap", n, insNs, ops);
+
+	t = nowNs();
+	for (unsigned int r = 0; r < reps; r++) {
+		for (unsigned int i = 0; i < n; i++) {
+			checksum += hashMapGet(&map, lookups[i]) != NULL;
+		}
+	}
+	snprintf(name, sizeof(name), "%s_hit", setName);
+	report(name, "hashmap", n, nowNs() - t, ops);
+
+	/* Precomputed hashes, like a script that resolves its model names once */
+	uint32_t *hashes = malloc(n * sizeof(uint32_t));
+	for (unsigned int i = 0; i < n; i++) {
+		hashes[i] = hashString(lookups[i]);
+	}
+	t = nowNs();
+	for (unsigned int r = 0; r < reps; r++) {
+		for (unsigned int i = 0; i < n; i++) {
+			checksum += hashMapGetHashed(&map, lookups[i], hashes[i]) != NULL;
+		}
+	}
+	snprintf(name, sizeof(name), "%s_hit_hashed", setName);
+	report(name, "hashmap", n, nowNs() - t, ops);
+	free(hashes);
+
+	unsigned int mapMissHits = 0;
+	t = nowNs();
+	for (unsigned int r = 0; r < reps; r++) {
+		for (unsigned int i = 0; i < n; i++) {
+			mapMissHits += hashMapGet(&map, misses[i]) != NULL;
+		}
+	}
+	snprintf(name, sizeof(name), "%s_miss", setName);
+	report(name, "hashmap", n, nowNs() - t, ops);
+
+	if (map.count != n || mapMissHits != htMissHits) {
+		fail("hash: %s with %u keys: map has %u entries, %u/%u misses found\n", setName, n, map.count, mapMissHits, htMissHits);
+	}
+	hashMapDestroy(&map);
+
+	free(entries);
+	free(misses);
+	free(lookups);
+	free(keys);
+}
+
+int main(void) {
+	memInit();
+
+	printf("name,table,keys,ns_per_op\n");
+	for (unsigned int i = 0; i < sizeof(keyCounts) / sizeof(keyCounts[0]); i++) {
+		benchSet("model", makeModelKeys, keyCounts[i]);
+		benchSet("anagram", makeAnagramKeys, keyCounts[i]);
+	}
+	fprintf(stderr, "checksum %u\n", checksum);
+	return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Ichigo coroutine stack benchmark, replays the call frame and register pushes of deep call chains
+ * with the old +4 growth and with the current IchigoVector growth.
+ * Output is one CSV line per measurement: policy,depth,regs_per_frame,reallocs,ns_per_call
+ */
+
+#define _POSIX_C_SOURCE 199309L
+#include "../../src/ichigo/ich.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+
+#if defined(_WIN32) || defined(_WIN64)
+static double nowNs(void) {
+	LARGE_INTEGER freq, cnt;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&cnt);
+	return (double)cnt.QuadPart * 1e9 / (double)freq.QuadPart;
+}
+#else
+#include <time.h>
+static double nowNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+#endif
+
+/* The engine normally gets these from assets.c and drawvm.c */
+void logNorm(const char *fmt, ...) {
+	(void)fmt;
+}
+void fail(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	exit(1);
+}
+size_t ichLoadFile(const char **fileData, void **userData, const char *fileName) {
+	(void)fileData;
+	(void)userData;
+	(void)fileName;
+	return 0;
+}
+void ichFreeFile(void *userData) {
+	(void)userData;
+}
+
+/* Aim for about this many calls per measurement */
+#define BENCH_CALLS 200000
+
+static const unsigned int depths[] = { 4, 16, 64, 100 }; /* Scripts can use up to 0x1000 registers */
+static const unsigned int regsPerFrame[] = { 2, 8, 32 };
+
+static unsigned int reallocs;
+
+/* Growth before geometric vectors: 4 more elements per append, r + 4 in ichGetReg */
+static void *oldAppend(struct IchigoVector *vec) {
+	if (vec->nElements == vec->nAllocations) {
+		unsigned int newAllocations = (vec->nAllocations == 0) ? 4 : vec->nAllocations + 4;
+		vec->data = ichRealloc(vec->data, newAllocations * vec->elementSize);
+		memset((char *)vec->data + vec->nAllocations * vec->elementSize, 0, (newAllocations - vec->nAllocations) * vec->elementSize);
+		vec->nAllocations = newAllocations;
+		reallocs++;
+	}
+	return &vec->data[vec->nElements++ * vec->elementSize];
+}
+static void oldReserve(struct IchigoVector *vec, unsigned int n) {
+	if (n > vec->nAllocations) {
+		unsigned int st = vec->nAllocations;
+		vec->nAllocations = n + 3;
+		vec->data = ichRealloc(vec->data, vec->nAllocations * vec->elementSize);
+		memset((char *)vec->data + st * vec->elementSize, 0, (vec->nAllocations - st) * vec->elementSize);
+		reallocs++;
+	}
+}
+
+static void *newAppend(struct IchigoVector *vec) {
+	uint16_t before = vec->nAllocations;
+	void *ret = ichVecAppend(vec);
+	reallocs += vec->nAllocations != before;
+	return ret;
+}
+static void newReserve(struct IchigoVector *vec, unsigned int n) {
+	uint16_t before = vec->nAllocations;
+	ichVecReserve(vec, n);
+	reallocs += vec->nAllocations != before;
+}
+
+/* One coroutine that calls depth nested functions, each with one argument and nRegs registers, then returns */
+static void runChain(bool old, unsigned int depth, unsigned int nRegs) {
+	struct IchigoVector callFrames, regs;
+	if (old) {
+		ichVecCreate(&callFrames, sizeof(struct IchigoCallFrame));
+		ichVecCreate(&regs, sizeof(struct IchigoReg));
+	} else {
+		ichVecCreateCap(&callFrames, sizeof(struct IchigoCallFrame), ICH_INIT_CALL_FRAMES);
+		ichVecCreateCap(&regs, sizeof(struct IchigoReg), ICH_INIT_REGS);
+	}
+
+	for (unsigned int d = 0; d < depth; d++) {
+		struct IchigoReg *arg = old ? oldAppend(&regs) : newAppend(&regs);
+		arg->regType = REG_INT;
+		struct IchigoCallFrame *cf = old ? oldAppend(&callFrames) : newAppend(&callFrames);
+		cf->regBase = regs.nElements;
+		cf->nArgs = 1;
+		cf->nRegs = nRegs;
+		/* Touching the highest register first is what ichGetReg sees for locals declared up front */
+		unsigned int top = regs.nElements + nRegs;
+		if (old) {
+			oldReserve(&regs, top);
+		} else {
+			newReserve(&regs, top);
+		}
+		regs.nElements = top;
+	}
+	while (callFrames.nElements) {
+		struct IchigoCallFrame *cf = ichVecAt(&callFrames, callFrames.nElements - 1);
+		regs.nElements -= cf->nArgs + cf->nRegs;
+		callFrames.nElements--;
+	}
+
+	ichVecDestroy(&callFrames);
+	ichVecDestroy(&regs);
+}
+
+int main(void) {
+	memInit();
+
+	printf("policy,depth,regs_per_frame,reallocs,ns_per_call\n");
+	for (unsigned int i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+		for (unsigned int j = 0; j < sizeof(regsPerFrame) / sizeof(regsPerFrame[0]); j++) {
+			unsigned int depth = depths[i];
+			unsigned int nRegs = regsPerFrame[j];
+			unsigned int chains = BENCH_CALLS / depth;
+			for (int old = 1; old >= 0; old--) {
+				reallocs = 0;
+				runChain(old, depth, nRegs);
+				unsigned int chainReallocs = reallocs;
+
+				double t = nowNs();
+				for (unsigned int c = 0; c < chains; c++) {
+					runChain(old, depth, nRegs);
+				}
+				double ns = (nowNs() - t) / ((double)chains * depth);
+				printf("%s,%u,%u,%u,%.2f\n", old ? "add4" : "geometric", depth, nRegs, chainReallocs, ns);
+			}
+		}
+	}
+	return 0;
+}